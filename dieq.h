@@ -36,8 +36,36 @@ SOFTWARE.
 #  define false 0
 #endif // __bool_true_false_are_defined
 
+// Everything that needs an operating system (mmap, NUMA policies, ...) is only compiled
+// on Linux hosts. Define DIEQ_FREESTANDING to keep the header libc free there too. Strict ISO
+// modes such as -std=c11 hide the POSIX and Linux interfaces it relies on, so there it is only
+// compiled when _DEFAULT_SOURCE or _GNU_SOURCE is defined before any system header is included,
+// on the command line being the safe place for it.
+#if defined(__linux__) && !defined(DIEQ_FREESTANDING)
+#  if !defined(__STRICT_ANSI__) || defined(_DEFAULT_SOURCE) || defined(_GNU_SOURCE)
+#    define DIEQ__LINUX 1
+#  endif // __STRICT_ANSI__
+#endif // __linux__
+
+// Thread local storage needs a runtime that sets it up, freestanding builds go without it
+#if defined(DIEQ_FREESTANDING)
+#  define DIEQ__THREAD_LOCAL
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#  define DIEQ__THREAD_LOCAL _Thread_local
+#else
+#  define DIEQ__THREAD_LOCAL __thread
+#endif // DIEQ_FREESTANDING
+
 typedef __SIZE_TYPE__ dieq_uisz;
 typedef unsigned char dieq_byte;
+typedef __UINT32_TYPE__ dieq_u32;
+typedef __UINT64_TYPE__ dieq_u64;
+
+// Sets and copies at least this big bypass the cache with streaming stores on x86,
+// so zeroing or moving a huge block does not evict everybody else's working set.
+#ifndef DIEQ_NON_TEMPORAL_THRESHOLD
+#  define DIEQ_NON_TEMPORAL_THRESHOLD (2*1024*1024)
+#endif // DIEQ_NON_TEMPORAL_THRESHOLD
 
 void *dieq_mem_set(void *ptr, dieq_byte b, dieq_uisz count);
 void *dieq_mem_cpy(void *restrict dst, void *restrict src, dieq_uisz count);
@@ -50,429 +78,2767 @@ typedef struct {
   Dieq_Mem_Free  free;
 } Dieq_Allocator;
 
+// Allocator interface that carries its own state, so an allocator can be backed by one specific
+// heap, arena or pool instead of global state. `align` is a power of two, frees get told the size
+// that was asked for and a NULL `ptr` makes resize behave like alloc.
+typedef void *(*Dieq_Ctx_Alloc)(void *ctx, dieq_uisz size, dieq_uisz align);
+typedef void *(*Dieq_Ctx_Resize)(void *ctx, void *ptr, dieq_uisz old_size, dieq_uisz new_size, dieq_uisz align);
+typedef void (*Dieq_Ctx_Free)(void *ctx, void *ptr, dieq_uisz size);
+
+typedef struct {
+  void *ctx;
+  Dieq_Ctx_Alloc  alloc;
+  Dieq_Ctx_Resize resize;
+  Dieq_Ctx_Free   free;
+} Dieq_Ctx_Allocator;
+
+// A heap lives at the start of the region it manages, the rest of the region is handed out as blocks.
+// All of its metadata is stored as offsets from the heap itself (0 meaning none), so a heap image
+// works wherever it gets mapped or copied to.
+typedef struct {
+  dieq_uisz magic;   // Tells a heap image apart from garbage
+  dieq_uisz version;
+  dieq_uisz size;    // Bytes from the heap header up to the end of the region
+  dieq_uisz clean;   // [clean, size) has never been handed out and is known to be all zeroes
+  dieq_uisz head;
+  dieq_uisz root;    // Entry point to the data of a persistent heap, see dieq_heap_set_root
+  unsigned int lock;
+  bool synchronized; // Take `lock` around every operation, needed when several threads share the heap
+} Dieq_Heap;
+
+Dieq_Heap *dieq_heap_create(void *start, void *end);
+
+// Same as dieq_heap_create for a region that is already zeroed (fresh mmap pages for example),
+// blocks carved out of memory nobody has used yet skip the zeroing in dieq_heap_alloc.
+Dieq_Heap *dieq_heap_create_zeroed(void *start, void *end);
+
+// Returns the heap whose image starts at `image`, which may be a copy or a mapping of a heap
+// created at any other address, or NULL when there is no heap there.
+Dieq_Heap *dieq_heap_attach(void *image);
+
+void *dieq_heap_alloc(Dieq_Heap *heap, dieq_uisz size);
+
+void dieq_heap_free(Dieq_Heap *heap, void *ptr);
+
+void *dieq_heap_realloc(Dieq_Heap *heap, void *ptr, dieq_uisz new_size);
+
+// `align` must be a power of two, the gap left in front of the block stays free space.
+void *dieq_heap_alloc_aligned(Dieq_Heap *heap, dieq_uisz size, dieq_uisz align);
+
+bool dieq_heap_owns(Dieq_Heap *heap, void *ptr);
+
+Dieq_Ctx_Allocator dieq_heap_ctx_allocator(Dieq_Heap *heap);
+
 void dieq_global_setup(void *start, void *end);
 
+// dieq_global_setup for a region the caller guarantees to be zeroed, dieq_alloc does not clear
+// blocks carved from its untouched part.
+void dieq_global_setup_zeroed(void *start, void *end);
+
 void *dieq_alloc(dieq_uisz size);
 
-void dieq_free(void *ptr);
+void dieq_free(void *ptr);
+
+void *dieq_realloc(void *ptr, dieq_uisz new_size);
+
+#ifdef DIEQ__LINUX
+#  ifndef DIEQ_NUMA_MAX_NODES
+#    define DIEQ_NUMA_MAX_NODES 64
+#  endif // DIEQ_NUMA_MAX_NODES
+
+// Maps one heap per NUMA node, bound to that node. Until dieq_numa_teardown is called
+// dieq_alloc serves every thread from the heap of the node it runs on and dieq_free hands
+// blocks back to whichever node heap owns them.
+bool dieq_numa_setup(dieq_uisz bytes_per_node);
+
+void dieq_numa_teardown(void);
+
+dieq_uisz dieq_numa_node_count(void);
+
+Dieq_Heap *dieq_numa_heap(dieq_uisz node);
+
+// The heaps mapped by the functions below are remembered by the process that mapped them, at
+// most this many at once. Mapping more fails until some are closed.
+#  ifndef DIEQ_HEAP_MAX_MAPPINGS
+#    define DIEQ_HEAP_MAX_MAPPINGS 64
+#  endif // DIEQ_HEAP_MAX_MAPPINGS
+
+// Maps the file at `path` and returns the heap living in it, all of the heap metadata is inside
+// the file. A missing or empty file is sized to `size` bytes and gets a fresh heap, a file that
+// already holds one is mapped back (at any address) with its blocks intact. Fails on files that
+// hold something else.
+Dieq_Heap *dieq_heap_open_file(const char *path, dieq_uisz size);
+
+// Blocks until every change made to a file backed heap is written to the file. Fails for heaps
+// that this process did not map from a file or shared memory, copies of their images included.
+bool dieq_heap_checkpoint(Dieq_Heap *heap);
+
+// Unmaps a heap that came from dieq_heap_open_file, dieq_heap_*_shared or dieq_heap_*_fd, any
+// other heap is left alone.
+void dieq_heap_close_file(Dieq_Heap *heap);
+
+// Makes the global heap a file backed one, see dieq_heap_open_file.
+bool dieq_global_setup_file(const char *path, dieq_uisz size);
+
+// Heaps shared between processes. Every process maps the same segment (at whatever address)
+// and may alloc and free blocks of it, the heap lock is a spin lock living in the segment itself.
+// Blocks are named across processes by their offset, see dieq_heap_offset_of.
+// A process that dies while holding the lock leaves the heap locked for everybody else.
+
+// Creates the POSIX shared memory object `name` (see shm_open) holding a heap of `size` bytes.
+// glibc before 2.34 keeps shm_open in librt, programs using these have to link with -lrt there.
+Dieq_Heap *dieq_heap_create_shared(const char *name, dieq_uisz size);
+
+Dieq_Heap *dieq_heap_open_shared(const char *name);
+
+bool dieq_heap_unlink_shared(const char *name);
+
+// Anonymous variant backed by a memfd, `fd` is what children inherit or other processes receive.
+Dieq_Heap *dieq_heap_create_memfd(dieq_uisz size, int *fd);
+
+// Maps the shared heap behind `fd`, the descriptor can be closed afterwards.
+Dieq_Heap *dieq_heap_open_fd(int fd);
+#endif // DIEQ__LINUX
+
+// The root is how a program finds its data again after reopening a persistent heap.
+void dieq_heap_set_root(Dieq_Heap *heap, void *root);
+
+void *dieq_heap_get_root(Dieq_Heap *heap);
+
+// Offsets are stable across every mapping of a heap, unlike the pointers into it.
+dieq_uisz dieq_heap_offset_of(Dieq_Heap *heap, void *ptr);
+
+void *dieq_heap_at(Dieq_Heap *heap, dieq_uisz offset);
+
+
+typedef struct Dieq__Arena_Block Dieq__Arena_Block;
+
+typedef struct {
+  dieq_uisz peak;     // Highest save point the arena ever reached
+  dieq_uisz allocs;   // Allocations handed out, extends not included
+  dieq_uisz waste;    // Bytes of padding spent on alignment
+  dieq_uisz failures; // Allocations and extends that did not fit
+} Dieq_Arena_Stats;
+
+typedef struct Dieq_Arena Dieq_Arena;
+
+struct Dieq_Arena {
+  dieq_byte *buf;
+  dieq_uisz idx;
+  dieq_uisz cap;
+  Dieq_Allocator allocator;
+  Dieq_Ctx_Allocator ctx_allocator; // Takes precedence over `allocator` when set
+  Dieq__Arena_Block *block; // Growable arenas only, the chained block `buf` belongs to
+  dieq_uisz committed;      // Virtual arenas only, bytes at the start of `buf` backed by memory
+  bool reserved;            // `buf` is an address range reserved with dieq_arena_init_virtual
+  Dieq_Arena_Stats stats;
+  const char *name;         // Registered arenas only, as passed to dieq_arena_register
+  Dieq_Arena *registry_prev;
+  Dieq_Arena *registry_next;
+  bool registered;
+};
+
+bool dieq_arena_init(Dieq_Arena *arena, dieq_uisz capacity);
+
+bool dieq_arena_init_with_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator);
+
+bool dieq_arena_init_with_ctx_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Ctx_Allocator allocator);
+
+// A growable arena chains a new block from its allocator whenever the current one fills up, each
+// one at least twice as big as the one before. Save points stay valid across blocks and the
+// blocks a restore leaves empty are kept for the allocations that follow.
+bool dieq_arena_init_growable(Dieq_Arena *arena, dieq_uisz capacity);
+
+bool dieq_arena_init_growable_with_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator);
+
+bool dieq_arena_init_growable_with_ctx_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Ctx_Allocator allocator);
+
+bool dieq_arena_init_from_buffer(Dieq_Arena *arena, void *buf, dieq_uisz buf_len);
+
+bool dieq_arena_deinit(Dieq_Arena *arena);
+
+void *dieq_arena_alloc(Dieq_Arena *arena, dieq_uisz size);
+
+// `align` must be a power of two, it applies to the address handed out and not just the size.
+void *dieq_arena_alloc_aligned(Dieq_Arena *arena, dieq_uisz size, dieq_uisz align);
+
+// Room for `count` items of `item_size` bytes, NULL when the total does not fit in a dieq_uisz.
+void *dieq_arena_alloc_array(Dieq_Arena *arena, dieq_uisz count, dieq_uisz item_size);
+
+void *dieq_arena_alloc_array_aligned(Dieq_Arena *arena, dieq_uisz count, dieq_uisz item_size, dieq_uisz align);
+
+#define dieq_arena_push(arena, Type) \
+  ((Type*)dieq_arena_alloc_aligned((arena), sizeof(Type), _Alignof(Type)))
+
+#define dieq_arena_push_array(arena, Type, count) \
+  ((Type*)dieq_arena_alloc_array_aligned((arena), (count), sizeof(Type), _Alignof(Type)))
+
+// Grows or shrinks `ptr` in place, only possible while it is the latest allocation of the arena
+// and there is room after it. Returns false and leaves the arena untouched otherwise.
+bool dieq_arena_extend(Dieq_Arena *arena, void *ptr, dieq_uisz old_size, dieq_uisz new_size);
+
+// Resizes in place through dieq_arena_extend when it can and falls back to a new allocation plus
+// a copy when it can't. A NULL `ptr` is a plain dieq_arena_alloc.
+void *dieq_arena_realloc(Dieq_Arena *arena, void *ptr, dieq_uisz old_size, dieq_uisz new_size);
+
+// Frees only roll the arena back when they hit its latest allocation, like dieq_arena_extend.
+Dieq_Ctx_Allocator dieq_arena_ctx_allocator(Dieq_Arena *arena);
+
+dieq_uisz dieq_arena_save_point(Dieq_Arena *arena);
+
+void dieq_arena_restore_point(Dieq_Arena *arena, dieq_uisz save_point);
+
+Dieq_Arena_Stats dieq_arena_stats(Dieq_Arena *arena);
+
+// Starts a new measurement with the peak at the current save point
+void dieq_arena_reset_stats(Dieq_Arena *arena);
+
+// The registry is a process-wide list of live arenas, so their stats can be collected from one
+// place. Arenas are registered after init and dieq_arena_deinit unregisters them by itself. The
+// callback runs with the registry locked and must not register or unregister arenas, and the
+// stats of arenas owned by other threads are read while those threads may still update them.
+typedef void (*Dieq_Arena_Visit)(Dieq_Arena *arena, void *user);
+
+void dieq_arena_register(Dieq_Arena *arena, const char *name);
+
+void dieq_arena_unregister(Dieq_Arena *arena);
+
+void dieq_arena_registry_foreach(Dieq_Arena_Visit visit, void *user);
+
+#ifdef DIEQ__LINUX
+// Virtual arenas commit their pages in chunks of this many bytes, a multiple of the page size
+#  ifndef DIEQ_ARENA_COMMIT_SIZE
+#    define DIEQ_ARENA_COMMIT_SIZE (64*1024)
+#  endif // DIEQ_ARENA_COMMIT_SIZE
+
+// A virtual arena reserves `reserve` bytes of address space without backing them and commits
+// pages as `idx` moves forward. Allocations stay contiguous and never move, and only the pages
+// the arena actually reached count toward the RSS.
+bool dieq_arena_init_virtual(Dieq_Arena *arena, dieq_uisz reserve);
+#endif // DIEQ__LINUX
+
+// Restores the save point and gives the memory more than `retain` bytes past it back. Growable
+// arenas free the blocks they kept that lie entirely past the threshold. On Linux virtual arenas
+// decommit the pages past it, and arenas with a buffer from their allocator have those pages
+// dropped with madvise so they are no longer resident until written again. Buffers handed to
+// dieq_arena_init_from_buffer belong to the caller and only get the restore.
+void dieq_arena_restore_point_decommit(Dieq_Arena *arena, dieq_uisz save_point, dieq_uisz retain);
+
+void dieq_arena_reset_decommit(Dieq_Arena *arena, dieq_uisz retain);
+
+// Every thread owns DIEQ_SCRATCH_COUNT scratch arenas for temporary memory, created on first use:
+// virtual arenas reserving DIEQ_SCRATCH_SIZE bytes on Linux, growable ones starting at that size
+// anywhere else, allocated from the global heap under its lock. Threads that call dieq_alloc on
+// their own meanwhile still need a synchronized global heap there. DIEQ_FREESTANDING builds have
+// no thread local storage, their scratch arenas are shared by the whole program and must only be
+// used from one thread.
+#ifndef DIEQ_SCRATCH_COUNT
+#  define DIEQ_SCRATCH_COUNT 2
+#endif // DIEQ_SCRATCH_COUNT
+
+#ifndef DIEQ_SCRATCH_SIZE
+#  ifdef DIEQ__LINUX
+#    define DIEQ_SCRATCH_SIZE (64*1024*1024)
+#  else
+#    define DIEQ_SCRATCH_SIZE (64*1024)
+#  endif // DIEQ__LINUX
+#endif // DIEQ_SCRATCH_SIZE
+
+typedef struct {
+  Dieq_Arena *arena;
+  dieq_uisz save_point;
+} Dieq_Scratch;
+
+// Hands out a scratch arena of the calling thread that is not one of the `conflicts`, usually the
+// arena the caller is putting its results in. `arena` is NULL when every scratch arena conflicts.
+Dieq_Scratch dieq_scratch_begin(Dieq_Arena **conflicts, dieq_uisz conflicts_count);
+
+// Gives everything allocated since dieq_scratch_begin back, it is just a restore of the save point.
+void dieq_scratch_end(Dieq_Scratch scratch);
+
+// Frees the scratch arenas of the calling thread, threads that used them should call it before exiting.
+void dieq_scratch_release_thread(void);
+
+// A dual arena bumps from both ends of one buffer, usually persistent data from the bottom and
+// temporaries from the top. Each end has its own save points, so the temporaries can be dropped
+// without touching what the bottom holds. Top save points are offsets from the start of `buf`.
+typedef struct {
+  dieq_byte *buf;
+  dieq_uisz bottom;
+  dieq_uisz top;
+  dieq_uisz cap;
+  Dieq_Allocator allocator;
+} Dieq_Dual_Arena;
+
+bool dieq_dual_arena_init(Dieq_Dual_Arena *arena, dieq_uisz capacity);
+
+bool dieq_dual_arena_init_with_allocator(Dieq_Dual_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator);
+
+bool dieq_dual_arena_init_from_buffer(Dieq_Dual_Arena *arena, void *buf, dieq_uisz buf_len);
+
+bool dieq_dual_arena_deinit(Dieq_Dual_Arena *arena);
+
+void *dieq_dual_arena_alloc_bottom(Dieq_Dual_Arena *arena, dieq_uisz size);
+
+void *dieq_dual_arena_alloc_bottom_aligned(Dieq_Dual_Arena *arena, dieq_uisz size, dieq_uisz align);
+
+void *dieq_dual_arena_alloc_top(Dieq_Dual_Arena *arena, dieq_uisz size);
+
+void *dieq_dual_arena_alloc_top_aligned(Dieq_Dual_Arena *arena, dieq_uisz size, dieq_uisz align);
+
+dieq_uisz dieq_dual_arena_save_bottom(Dieq_Dual_Arena *arena);
+
+void dieq_dual_arena_restore_bottom(Dieq_Dual_Arena *arena, dieq_uisz save_point);
+
+dieq_uisz dieq_dual_arena_save_top(Dieq_Dual_Arena *arena);
+
+void dieq_dual_arena_restore_top(Dieq_Dual_Arena *arena, dieq_uisz save_point);
+
+// An atomic arena can be allocated from by many threads at once without a lock, every
+// allocation is a fetch-add on `idx`. Threads that allocate often should go through their own
+// Dieq_Atomic_Arena_Local, which reserves `chunk_size` bytes at a time and bumps inside them
+// without touching the shared counter. Nothing may allocate while the arena is being reset.
+#ifndef DIEQ_CACHE_LINE_SIZE
+#  define DIEQ_CACHE_LINE_SIZE 64
+#endif // DIEQ_CACHE_LINE_SIZE
+
+typedef struct {
+  dieq_byte *buf;
+  dieq_uisz start; // First pointer aligned offset into `buf`, where `idx` goes back to on reset
+  dieq_uisz cap;
+  dieq_uisz chunk_size;
+  dieq_uisz generation; // Bumped by every reset, chunks reserved before it are abandoned
+  Dieq_Allocator allocator;
+  // Every claim writes `idx`, the padding keeps it off the lines of the fields read next to it
+  dieq_byte pad_before[DIEQ_CACHE_LINE_SIZE];
+  dieq_uisz idx;
+  dieq_byte pad_after[DIEQ_CACHE_LINE_SIZE];
+} Dieq_Atomic_Arena;
+
+// Owned by a single thread, zero initialized before its first use
+typedef struct {
+  dieq_uisz generation;
+  dieq_uisz idx;
+  dieq_uisz end;
+} Dieq_Atomic_Arena_Local;
+
+bool dieq_atomic_arena_init(Dieq_Atomic_Arena *arena, dieq_uisz capacity, dieq_uisz chunk_size);
+
+bool dieq_atomic_arena_init_with_allocator(Dieq_Atomic_Arena *arena, dieq_uisz capacity, dieq_uisz chunk_size, Dieq_Allocator allocator);
+
+bool dieq_atomic_arena_init_from_buffer(Dieq_Atomic_Arena *arena, void *buf, dieq_uisz buf_len, dieq_uisz chunk_size);
+
+bool dieq_atomic_arena_deinit(Dieq_Atomic_Arena *arena);
+
+void *dieq_atomic_arena_alloc(Dieq_Atomic_Arena *arena, dieq_uisz size);
+
+void *dieq_atomic_arena_alloc_aligned(Dieq_Atomic_Arena *arena, dieq_uisz size, dieq_uisz align);
+
+void *dieq_atomic_arena_alloc_local(Dieq_Atomic_Arena *arena, Dieq_Atomic_Arena_Local *local, dieq_uisz size);
+
+void *dieq_atomic_arena_alloc_local_aligned(Dieq_Atomic_Arena *arena, Dieq_Atomic_Arena_Local *local, dieq_uisz size, dieq_uisz align);
+
+void dieq_atomic_arena_reset(Dieq_Atomic_Arena *arena);
+
+// The recycler keeps arenas that were released so the next acquire of a similar capacity reuses
+// one instead of allocating. Capacities round up to a power of two size class starting at
+// DIEQ_RECYCLER_MIN_SIZE, and bigger ones bypass the recycler. On Linux the arenas are virtual
+// ones and trimming only decommits their pages, elsewhere it frees the arena.
+#ifndef DIEQ_RECYCLER_CLASSES
+#  define DIEQ_RECYCLER_CLASSES 8
+#endif // DIEQ_RECYCLER_CLASSES
+
+#ifndef DIEQ_RECYCLER_SLOTS
+#  define DIEQ_RECYCLER_SLOTS 8
+#endif // DIEQ_RECYCLER_SLOTS
+
+#ifndef DIEQ_RECYCLER_MIN_SIZE
+#  define DIEQ_RECYCLER_MIN_SIZE (64*1024)
+#endif // DIEQ_RECYCLER_MIN_SIZE
+
+typedef struct {
+  Dieq_Arena arena;
+  dieq_uisz idle; // Trims this arena went through without being acquired
+} Dieq__Recycled_Arena;
+
+typedef struct {
+  Dieq__Recycled_Arena slots[DIEQ_RECYCLER_CLASSES][DIEQ_RECYCLER_SLOTS];
+  dieq_uisz counts[DIEQ_RECYCLER_CLASSES];
+  dieq_uisz max_per_class;
+  unsigned int lock;
+} Dieq_Arena_Recycler;
+
+// Keeps at most `max_per_class` arenas of each size class, capped at DIEQ_RECYCLER_SLOTS
+void dieq_arena_recycler_init(Dieq_Arena_Recycler *recycler, dieq_uisz max_per_class);
+
+void dieq_arena_recycler_deinit(Dieq_Arena_Recycler *recycler);
+
+// Fills `arena` with an empty arena that holds at least `capacity` bytes
+bool dieq_arena_recycler_acquire(Dieq_Arena_Recycler *recycler, Dieq_Arena *arena, dieq_uisz capacity);
+
+// Takes the arena back and empties it, it is freed when its size class is already full
+void dieq_arena_recycler_release(Dieq_Arena_Recycler *recycler, Dieq_Arena *arena);
+
+// Meant to be called periodically, arenas left idle for more than `max_idle` calls give their
+// memory back.
+void dieq_arena_recycler_trim(Dieq_Arena_Recycler *recycler, dieq_uisz max_idle);
+
+typedef struct Dieq__Pool_Chunk Dieq__Pool_Chunk;
+
+typedef struct {
+  void *buf;
+  void *free_list_head;
+  dieq_uisz item_size;
+  dieq_uisz cap;
+  dieq_uisz slot_size;
+  dieq_uisz align; // Of every slot, `buf` itself may start before the first one
+  dieq_uisz used;
+  dieq_uisz peak; // Highest `used` since init or the last clear
+  dieq_byte *bump;     // Slots from here up to `bump_end` were not handed out since init or clear
+  dieq_byte *bump_end;
+  Dieq_Allocator allocator;
+  Dieq_Ctx_Allocator ctx_allocator; // Takes precedence over `allocator` when set
+  Dieq__Pool_Chunk *chunks;         // Growable pools only, newest first, `buf` is NULL for them
+  Dieq__Pool_Chunk *bump_next;      // Growable pools only, next chunk to bump through after a clear
+} Dieq_Pool;
+
+// Pools never write their slots up front and items are not zeroed. The ones backed by the global
+// heap take their memory without having it cleared, so their init costs the same at any capacity
+// and the slots stay out of the RSS until used. Other allocators may still clear what they hand out.
+bool dieq_pool_init(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity);
+
+bool dieq_pool_init_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator);
+
+bool dieq_pool_init_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Ctx_Allocator allocator);
+
+bool dieq_pool_init_from_buffer(Dieq_Pool *pool, void *buf, dieq_uisz buf_len, dieq_uisz item_size);
+
+// Slots of aligned pools start on a multiple of `align`, a power of two, and are padded up to one
+// so neighbouring items never share a cache line when it is DIEQ_CACHE_LINE_SIZE. Context
+// allocators are asked for that alignment, plain ones allocate enough slack to align the first slot.
+bool dieq_pool_init_aligned(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align);
+
+bool dieq_pool_init_aligned_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Allocator allocator);
+
+bool dieq_pool_init_aligned_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Ctx_Allocator allocator);
+
+// A growable pool allocates another chunk of items from its allocator whenever it runs out, each
+// one twice as big as the last. Items never move, and dieq_pool_trim gives back the chunks that
+// have no item in use.
+bool dieq_pool_init_growable(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity);
+
+bool dieq_pool_init_growable_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator);
+
+bool dieq_pool_init_growable_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Ctx_Allocator allocator);
+
+bool dieq_pool_init_growable_aligned(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align);
+
+bool dieq_pool_init_growable_aligned_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Allocator allocator);
+
+bool dieq_pool_init_growable_aligned_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Ctx_Allocator allocator);
+
+bool dieq_pool_deinit(Dieq_Pool *pool);
+
+void *dieq_pool_request(Dieq_Pool *pool);
+
+void dieq_pool_release(Dieq_Pool *pool, void *item);
+
+void dieq_pool_clear(Dieq_Pool *pool);
+
+dieq_uisz dieq_pool_count_free_nodes(Dieq_Pool *pool);
+
+dieq_uisz dieq_pool_count_used_nodes(Dieq_Pool *pool);
+
+dieq_uisz dieq_pool_peak_used_nodes(Dieq_Pool *pool);
+
+// Frees the chunks of a growable pool without any item in use, except the first one it was
+// created with. Returns how many items the pool lost, the walk over the free list is O(n).
+dieq_uisz dieq_pool_trim(Dieq_Pool *pool);
+
+// Hands out whole items, allocations bigger than `item_size` or aligned past the slots fail.
+Dieq_Ctx_Allocator dieq_pool_ctx_allocator(Dieq_Pool *pool);
+
+// An atomic pool can be requested from and released to by many threads without a lock. Free
+// slots form a Treiber stack whose head packs a generation next to the slot index into 64 bits,
+// so a slot that was popped and pushed back in between never passes for the one a CAS expected.
+// Threads with a lot of traffic should go through their own Dieq_Atomic_Pool_Local, a magazine
+// of items that only touches the shared stack once it runs empty or full, and then moves half a
+// magazine with a single CAS.
+#ifndef DIEQ_POOL_MAGAZINE_SIZE
+#  define DIEQ_POOL_MAGAZINE_SIZE 32
+#endif // DIEQ_POOL_MAGAZINE_SIZE
+
+typedef struct {
+  dieq_byte *buf;
+  dieq_byte *items; // First pointer aligned address of `buf`, where the slots start
+  dieq_u32 cap;
+  dieq_uisz item_size;
+  dieq_uisz slot_size;
+  Dieq_Allocator allocator;
+  // Both counters are written by every thread, the padding keeps them apart and off the lines
+  // of the fields read next to them
+  dieq_byte pad_before[DIEQ_CACHE_LINE_SIZE];
+  dieq_u64 head; // Generation in the high half, index + 1 of the top slot in the low one
+  dieq_byte pad_head[DIEQ_CACHE_LINE_SIZE];
+  dieq_u32 fresh; // Slots from this index on were never handed out
+  dieq_byte pad_after[DIEQ_CACHE_LINE_SIZE];
+} Dieq_Atomic_Pool;
+
+// Owned by a single thread, zero initialized before its first use
+typedef struct {
+  dieq_uisz count;
+  void *items[DIEQ_POOL_MAGAZINE_SIZE];
+} Dieq_Atomic_Pool_Local;
+
+bool dieq_atomic_pool_init(Dieq_Atomic_Pool *pool, dieq_uisz item_size, dieq_uisz capacity);
+
+bool dieq_atomic_pool_init_with_allocator(Dieq_Atomic_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator);
+
+bool dieq_atomic_pool_init_from_buffer(Dieq_Atomic_Pool *pool, void *buf, dieq_uisz buf_len, dieq_uisz item_size);
+
+bool dieq_atomic_pool_deinit(Dieq_Atomic_Pool *pool);
+
+void *dieq_atomic_pool_request(Dieq_Atomic_Pool *pool);
+
+void dieq_atomic_pool_release(Dieq_Atomic_Pool *pool, void *item);
+
+void *dieq_atomic_pool_request_local(Dieq_Atomic_Pool *pool, Dieq_Atomic_Pool_Local *local);
+
+void dieq_atomic_pool_release_local(Dieq_Atomic_Pool *pool, Dieq_Atomic_Pool_Local *local, void *item);
+
+// Hands every item of the magazine back to the shared stack, threads should call it before exiting.
+void dieq_atomic_pool_flush_local(Dieq_Atomic_Pool *pool, Dieq_Atomic_Pool_Local *local);
+
+#endif // _DIEQ_H
+
+#ifdef DIEQ_IMPLEMENTATION
+
+#ifdef DIEQ__LINUX
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#endif // DIEQ__LINUX
+
+// Widest vector unit picked at compile time. On x86-64 hosts the AVX2 kernels are also built
+// when the compiler was not told about AVX2, and picked at runtime if the CPU has it.
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define DIEQ__SIMD_SSE2 1
+#endif // __SSE2__
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define DIEQ__SIMD_AVX2 1
+#  define DIEQ__TARGET_AVX2
+#  define dieq__cpu_has_avx2() true
+#elif defined(DIEQ__LINUX) && defined(__x86_64__)
+#  include <immintrin.h>
+#  define DIEQ__SIMD_AVX2 1
+#  define DIEQ__TARGET_AVX2 __attribute__((target("avx2")))
+#  define dieq__cpu_has_avx2() __builtin_cpu_supports("avx2")
+#endif // __AVX2__
+
+#if defined(__wasm_simd128__)
+#  include <wasm_simd128.h>
+#  define DIEQ__SIMD_WASM 1
+#endif // __wasm_simd128__
+
+typedef struct {
+  dieq_uisz next; // Offsets from the owning heap, 0 when there is no neighbour
+  dieq_uisz prev;
+  dieq_uisz size;
+  dieq_uisz padding;
+} Dieq__Block_Header;
+
+#define DIEQ__HEAP_MAGIC 0x51454944 // "DIEQ"
+#define DIEQ__HEAP_VERSION 2
+
+static Dieq_Heap *dieq__global_heap = NULL;
+
+static inline dieq_uisz dieq__align_forward(dieq_uisz n, dieq_uisz alignment) {
+  return (n + (alignment-1)) & ~(alignment-1);
+}
+
+static inline void dieq__cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static inline void dieq__spin_lock(unsigned int *lock) {
+  while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(lock, __ATOMIC_RELAXED)) dieq__cpu_relax();
+  }
+}
+
+static inline void dieq__spin_unlock(unsigned int *lock) {
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+// All kernels below expect `count` to be at least one vector wide. They write the first and last
+// vector unaligned and fill everything in between with aligned stores, the overlap is harmless.
+// Past DIEQ_NON_TEMPORAL_THRESHOLD the x86 kernels stream the aligned body around the cache and
+// fence before the trailing regular stores, so the block is fully visible when they return.
+// Both word types may alias anything, the callers hand in memory of whatever type they like.
+typedef dieq_uisz __attribute__((may_alias, aligned(1))) dieq__unaligned_word;
+typedef dieq_uisz __attribute__((may_alias)) dieq__word;
+
+static inline dieq_byte *dieq__next_aligned(dieq_byte *p, dieq_uisz width) {
+  return (dieq_byte*)(((dieq_uisz)p + width) & ~(width - 1));
+}
+
+static void dieq__mem_set_words(dieq_byte *dst, dieq_byte b, dieq_uisz count) {
+  dieq_uisz w = ((dieq_uisz)-1 / 0xFF) * b;
+  dieq_byte *end = dst + count;
+  *(dieq__unaligned_word*)dst = w;
+  for (dieq_byte *p = dieq__next_aligned(dst, sizeof(w)); p + sizeof(w) <= end; p += sizeof(w)) {
+    *(dieq__word*)p = w;
+  }
+  *(dieq__unaligned_word*)(end - sizeof(w)) = w;
+}
+
+static void dieq__mem_cpy_words(dieq_byte *dst, const dieq_byte *src, dieq_uisz count) {
+  dieq_byte *end = dst + count;
+  dieq_uisz tail = *(const dieq__unaligned_word*)(src + count - sizeof(tail));
+  *(dieq__unaligned_word*)dst = *(const dieq__unaligned_word*)src;
+  dieq_byte *d = dieq__next_aligned(dst, sizeof(tail));
+  const dieq_byte *s = src + (d - dst);
+  for (; d + sizeof(tail) <= end; d += sizeof(tail), s += sizeof(tail)) {
+    *(dieq__word*)d = *(const dieq__unaligned_word*)s;
+  }
+  *(dieq__unaligned_word*)(end - sizeof(tail)) = tail;
+}
+
+#ifdef DIEQ__SIMD_SSE2
+static void dieq__mem_set_sse2(dieq_byte *dst, dieq_byte b, dieq_uisz count) {
+  __m128i v = _mm_set1_epi8((char)b);
+  dieq_byte *end = dst + count;
+  _mm_storeu_si128((__m128i*)dst, v);
+  dieq_byte *p = dieq__next_aligned(dst, 16);
+  if (count >= DIEQ_NON_TEMPORAL_THRESHOLD) {
+    for (; p + 64 <= end; p += 64) {
+      _mm_stream_si128((__m128i*)p + 0, v);
+      _mm_stream_si128((__m128i*)p + 1, v);
+      _mm_stream_si128((__m128i*)p + 2, v);
+      _mm_stream_si128((__m128i*)p + 3, v);
+    }
+    _mm_sfence();
+  }
+  for (; p + 64 <= end; p += 64) {
+    _mm_store_si128((__m128i*)p + 0, v);
+    _mm_store_si128((__m128i*)p + 1, v);
+    _mm_store_si128((__m128i*)p + 2, v);
+    _mm_store_si128((__m128i*)p + 3, v);
+  }
+  for (; p + 16 <= end; p += 16) _mm_store_si128((__m128i*)p, v);
+  _mm_storeu_si128((__m128i*)(end - 16), v);
+}
+
+static void dieq__mem_cpy_sse2(dieq_byte *dst, const dieq_byte *src, dieq_uisz count) {
+  dieq_byte *end = dst + count;
+  __m128i tail = _mm_loadu_si128((const __m128i*)(src + count - 16));
+  _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+  dieq_byte *d = dieq__next_aligned(dst, 16);
+  const dieq_byte *s = src + (d - dst);
+  if (count >= DIEQ_NON_TEMPORAL_THRESHOLD) {
+    for (; d + 64 <= end; d += 64, s += 64) {
+      __m128i a = _mm_loadu_si128((const __m128i*)s + 0);
+      __m128i b = _mm_loadu_si128((const __m128i*)s + 1);
+      __m128i c = _mm_loadu_si128((const __m128i*)s + 2);
+      __m128i e = _mm_loadu_si128((const __m128i*)s + 3);
+      _mm_stream_si128((__m128i*)d + 0, a);
+      _mm_stream_si128((__m128i*)d + 1, b);
+      _mm_stream_si128((__m128i*)d + 2, c);
+      _mm_stream_si128((__m128i*)d + 3, e);
+    }
+    _mm_sfence();
+  }
+  for (; d + 64 <= end; d += 64, s += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i*)s + 0);
+    __m128i b = _mm_loadu_si128((const __m128i*)s + 1);
+    __m128i c = _mm_loadu_si128((const __m128i*)s + 2);
+    __m128i e = _mm_loadu_si128((const __m128i*)s + 3);
+    _mm_store_si128((__m128i*)d + 0, a);
+    _mm_store_si128((__m128i*)d + 1, b);
+    _mm_store_si128((__m128i*)d + 2, c);
+    _mm_store_si128((__m128i*)d + 3, e);
+  }
+  for (; d + 16 <= end; d += 16, s += 16) {
+    _mm_store_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+  }
+  _mm_storeu_si128((__m128i*)(end - 16), tail);
+}
+#endif // DIEQ__SIMD_SSE2
+
+#ifdef DIEQ__SIMD_AVX2
+DIEQ__TARGET_AVX2 static void dieq__mem_set_avx2(dieq_byte *dst, dieq_byte b, dieq_uisz count) {
+  __m256i v = _mm256_set1_epi8((char)b);
+  dieq_byte *end = dst + count;
+  _mm256_storeu_si256((__m256i*)dst, v);
+  dieq_byte *p = dieq__next_aligned(dst, 32);
+  if (count >= DIEQ_NON_TEMPORAL_THRESHOLD) {
+    for (; p + 128 <= end; p += 128) {
+      _mm256_stream_si256((__m256i*)p + 0, v);
+      _mm256_stream_si256((__m256i*)p + 1, v);
+      _mm256_stream_si256((__m256i*)p + 2, v);
+      _mm256_stream_si256((__m256i*)p + 3, v);
+    }
+    _mm_sfence();
+  }
+  for (; p + 128 <= end; p += 128) {
+    _mm256_store_si256((__m256i*)p + 0, v);
+    _mm256_store_si256((__m256i*)p + 1, v);
+    _mm256_store_si256((__m256i*)p + 2, v);
+    _mm256_store_si256((__m256i*)p + 3, v);
+  }
+  for (; p + 32 <= end; p += 32) _mm256_store_si256((__m256i*)p, v);
+  _mm256_storeu_si256((__m256i*)(end - 32), v);
+}
+
+DIEQ__TARGET_AVX2 static void dieq__mem_cpy_avx2(dieq_byte *dst, const dieq_byte *src, dieq_uisz count) {
+  dieq_byte *end = dst + count;
+  __m256i tail = _mm256_loadu_si256((const __m256i*)(src + count - 32));
+  _mm256_storeu_si256((__m256i*)dst, _mm256_loadu_si256((const __m256i*)src));
+  dieq_byte *d = dieq__next_aligned(dst, 32);
+  const dieq_byte *s = src + (d - dst);
+  if (count >= DIEQ_NON_TEMPORAL_THRESHOLD) {
+    for (; d + 128 <= end; d += 128, s += 128) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)s + 0);
+      __m256i b = _mm256_loadu_si256((const __m256i*)s + 1);
+      __m256i c = _mm256_loadu_si256((const __m256i*)s + 2);
+      __m256i e = _mm256_loadu_si256((const __m256i*)s + 3);
+      _mm256_stream_si256((__m256i*)d + 0, a);
+      _mm256_stream_si256((__m256i*)d + 1, b);
+      _mm256_stream_si256((__m256i*)d + 2, c);
+      _mm256_stream_si256((__m256i*)d + 3, e);
+    }
+    _mm_sfence();
+  }
+  for (; d + 128 <= end; d += 128, s += 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)s + 0);
+    __m256i b = _mm256_loadu_si256((const __m256i*)s + 1);
+    __m256i c = _mm256_loadu_si256((const __m256i*)s + 2);
+    __m256i e = _mm256_loadu_si256((const __m256i*)s + 3);
+    _mm256_store_si256((__m256i*)d + 0, a);
+    _mm256_store_si256((__m256i*)d + 1, b);
+    _mm256_store_si256((__m256i*)d + 2, c);
+    _mm256_store_si256((__m256i*)d + 3, e);
+  }
+  for (; d + 32 <= end; d += 32, s += 32) {
+    _mm256_store_si256((__m256i*)d, _mm256_loadu_si256((const __m256i*)s));
+  }
+  _mm256_storeu_si256((__m256i*)(end - 32), tail);
+}
+#endif // DIEQ__SIMD_AVX2
+
+#ifdef DIEQ__SIMD_WASM
+static void dieq__mem_set_wasm(dieq_byte *dst, dieq_byte b, dieq_uisz count) {
+  v128_t v = wasm_i8x16_splat((signed char)b);
+  dieq_byte *end = dst + count;
+  wasm_v128_store(dst, v);
+  dieq_byte *p = dieq__next_aligned(dst, 16);
+  for (; p + 16 <= end; p += 16) wasm_v128_store(p, v);
+  wasm_v128_store(end - 16, v);
+}
+
+static void dieq__mem_cpy_wasm(dieq_byte *dst, const dieq_byte *src, dieq_uisz count) {
+  dieq_byte *end = dst + count;
+  v128_t tail = wasm_v128_load(src + count - 16);
+  wasm_v128_store(dst, wasm_v128_load(src));
+  dieq_byte *d = dieq__next_aligned(dst, 16);
+  const dieq_byte *s = src + (d - dst);
+  for (; d + 16 <= end; d += 16, s += 16) wasm_v128_store(d, wasm_v128_load(s));
+  wasm_v128_store(end - 16, tail);
+}
+#endif // DIEQ__SIMD_WASM
+
+void *dieq_mem_set(void *ptr, dieq_byte b, dieq_uisz count) {
+  dieq_byte *data = (dieq_byte*)ptr;
+#ifdef DIEQ__SIMD_AVX2
+  if (count >= 32 && dieq__cpu_has_avx2()) {
+    dieq__mem_set_avx2(data, b, count);
+    return ptr;
+  }
+#endif // DIEQ__SIMD_AVX2
+#if defined(DIEQ__SIMD_SSE2)
+  if (count >= 16) {
+    dieq__mem_set_sse2(data, b, count);
+    return ptr;
+  }
+#elif defined(DIEQ__SIMD_WASM)
+  if (count >= 16) {
+    dieq__mem_set_wasm(data, b, count);
+    return ptr;
+  }
+#endif
+  if (count >= sizeof(dieq_uisz)) {
+    dieq__mem_set_words(data, b, count);
+    return ptr;
+  }
+
+  for (dieq_uisz i = 0; i < count; ++i) {
+    data[i] = b;
+  }
+  return ptr;
+}
+
+void *dieq_mem_cpy(void *restrict dst, void *restrict src, dieq_uisz count) {
+  dieq_byte *dst_buf = (dieq_byte*)dst;
+  dieq_byte *src_buf = (dieq_byte*)src;
+#ifdef DIEQ__SIMD_AVX2
+  if (count >= 32 && dieq__cpu_has_avx2()) {
+    dieq__mem_cpy_avx2(dst_buf, src_buf, count);
+    return dst;
+  }
+#endif // DIEQ__SIMD_AVX2
+#if defined(DIEQ__SIMD_SSE2)
+  if (count >= 16) {
+    dieq__mem_cpy_sse2(dst_buf, src_buf, count);
+    return dst;
+  }
+#elif defined(DIEQ__SIMD_WASM)
+  if (count >= 16) {
+    dieq__mem_cpy_wasm(dst_buf, src_buf, count);
+    return dst;
+  }
+#endif
+  if (count >= sizeof(dieq_uisz)) {
+    dieq__mem_cpy_words(dst_buf, src_buf, count);
+    return dst;
+  }
+
+  for (dieq_uisz i = 0; i < count; ++i) dst_buf[i] = src_buf[i];
+  return dst;
+}
+
+static inline dieq_uisz dieq__heap_first_block(void) {
+  return dieq__align_forward(sizeof(Dieq_Heap), sizeof(void*));
+}
+
+static inline Dieq__Block_Header *dieq__heap_block(Dieq_Heap *heap, dieq_uisz offset) {
+  return (Dieq__Block_Header*)((dieq_byte*)heap + offset);
+}
+
+// Sets up everything but the magic, so a heap other processes may already see is only taken
+// for one once dieq__heap_publish has run
+static Dieq_Heap *dieq__heap_init(void *start, void *end) {
+  if (start == NULL) return NULL;
+  dieq_byte *base = (dieq_byte*)dieq__align_forward((dieq_uisz)start, sizeof(void*));
+  if (base + dieq__heap_first_block() > (dieq_byte*)end) return NULL;
+
+  Dieq_Heap *heap = (Dieq_Heap*)base;
+  dieq_mem_set(heap, 0, sizeof(*heap));
+  heap->version = DIEQ__HEAP_VERSION;
+  heap->size = (dieq_uisz)((dieq_byte*)end - base);
+  heap->clean = heap->size;
+
+  return heap;
+}
+
+static inline Dieq_Heap *dieq__heap_publish(Dieq_Heap *heap) {
+  __atomic_store_n(&heap->magic, DIEQ__HEAP_MAGIC, __ATOMIC_RELEASE);
+  return heap;
+}
+
+Dieq_Heap *dieq_heap_create(void *start, void *end) {
+  Dieq_Heap *heap = dieq__heap_init(start, end);
+  if (heap == NULL) return NULL;
+  return dieq__heap_publish(heap);
+}
+
+Dieq_Heap *dieq_heap_create_zeroed(void *start, void *end) {
+  Dieq_Heap *heap = dieq__heap_init(start, end);
+  if (heap == NULL) return NULL;
+  heap->clean = dieq__heap_first_block();
+  return dieq__heap_publish(heap);
+}
+
+Dieq_Heap *dieq_heap_attach(void *image) {
+  Dieq_Heap *heap = (Dieq_Heap*)image;
+  if (heap == NULL || (dieq_uisz)image & (sizeof(void*) - 1)) return NULL;
+  if (heap->magic != DIEQ__HEAP_MAGIC || heap->version != DIEQ__HEAP_VERSION) return NULL;
+  return heap;
+}
+
+// `dirty_end` receives the offset where the memory of the new block stops needing to be zeroed
+static Dieq__Block_Header *dieq__heap_find_space(Dieq_Heap *heap, dieq_uisz desired_space, dieq_uisz align, dieq_uisz *dirty_end) {
+  dieq_uisz true_space = dieq__align_forward(desired_space, sizeof(void*));
+  dieq_uisz base = (dieq_uisz)heap + sizeof(Dieq__Block_Header);
+
+  // Blocks are linked in address order, so the free space is whatever lies between neighbours
+  dieq_uisz prev = 0;
+  dieq_uisz next = heap->head;
+  dieq_uisz space = dieq__heap_first_block();
+  for (;;) {
+    // Shift the block so the memory after its header lands on `align`
+    space = dieq__align_forward(base + space, align) - base;
+    dieq_uisz limit = next ? next : heap->size;
+    if (space <= limit && limit - space >= true_space) break;
+    if (next == 0) return NULL;
+
+    Dieq__Block_Header *node = dieq__heap_block(heap, next);
+    prev = next;
+    space = next + node->size;
+    next = node->next;
+  }
+
+  Dieq__Block_Header *space_header = dieq__heap_block(heap, space);
+  space_header->size = true_space;
+  space_header->padding = true_space - desired_space;
+  space_header->prev = prev;
+  space_header->next = next;
+  if (prev) dieq__heap_block(heap, prev)->next = space;
+  else heap->head = space;
+  if (next) dieq__heap_block(heap, next)->prev = space;
+
+  dieq_uisz block_end = space + true_space;
+  *dirty_end = block_end < heap->clean ? block_end : heap->clean;
+  if (block_end > heap->clean) heap->clean = block_end;
+
+  return space_header;
+}
+
+static bool dieq__heap_node_exists(Dieq_Heap *heap, dieq_uisz n) {
+  dieq_uisz node = heap->head;
+  while (node) {
+    if (node == n) return true;
+    node = dieq__heap_block(heap, node)->next;
+  }
+  return false;
+}
+
+bool dieq_heap_owns(Dieq_Heap *heap, void *ptr) {
+  if (heap == NULL) return false;
+  dieq_byte *p = (dieq_byte*)ptr;
+  dieq_byte *base = (dieq_byte*)heap;
+  return p >= base + dieq__heap_first_block() + sizeof(Dieq__Block_Header) && p < base + heap->size;
+}
+
+void *dieq_heap_alloc(Dieq_Heap *heap, dieq_uisz size) {
+  return dieq_heap_alloc_aligned(heap, size, sizeof(void*));
+}
+
+// Only clears the part of the block below the clean watermark when `zero` is set
+static void *dieq__heap_alloc(Dieq_Heap *heap, dieq_uisz size, dieq_uisz align, bool zero) {
+  if (heap == NULL) return NULL;
+  if (align == 0 || (align & (align - 1)) != 0) return NULL;
+  if (align < sizeof(void*)) align = sizeof(void*);
+  if (size > (dieq_uisz)-1 - 2*sizeof(Dieq__Block_Header)) return NULL;
+
+  dieq_uisz dirty_end = 0;
+  if (heap->synchronized) dieq__spin_lock(&heap->lock);
+  Dieq__Block_Header *header = dieq__heap_find_space(heap, sizeof(Dieq__Block_Header) + size, align, &dirty_end);
+  if (heap->synchronized) dieq__spin_unlock(&heap->lock);
+  if (header == NULL) return NULL;
+
+  dieq_byte *user_ptr = (dieq_byte*)header + sizeof(*header);
+  dieq_uisz user_offset = (dieq_uisz)(user_ptr - (dieq_byte*)heap);
+  if (zero && dirty_end > user_offset) dieq_mem_set(user_ptr, 0, dirty_end - user_offset);
+
+  return user_ptr;
+}
+
+void *dieq_heap_alloc_aligned(Dieq_Heap *heap, dieq_uisz size, dieq_uisz align) {
+  return dieq__heap_alloc(heap, size, align, true);
+}
+
+void dieq_heap_free(Dieq_Heap *heap, void *ptr) {
+  if (!dieq_heap_owns(heap, ptr)) {
+    return; // Maybe should print something here?
+  }
+
+  dieq_uisz offset = (dieq_uisz)((dieq_byte*)ptr - (dieq_byte*)heap) - sizeof(Dieq__Block_Header);
+  if (heap->synchronized) dieq__spin_lock(&heap->lock);
+  if (dieq__heap_node_exists(heap, offset)) {
+    Dieq__Block_Header *header = dieq__heap_block(heap, offset);
+    if (header->prev) dieq__heap_block(heap, header->prev)->next = header->next;
+    else heap->head = header->next;
+    if (header->next) dieq__heap_block(heap, header->next)->prev = header->prev;
+  }
+  // else: an error should be presented here since the pointer looks valid but it's not a known node
+  if (heap->synchronized) dieq__spin_unlock(&heap->lock);
+}
+
+static void dieq__copy_block_contents(void *new_ptr, void *old_ptr, dieq_uisz new_size) {
+  Dieq__Block_Header *old_header = (Dieq__Block_Header*)((dieq_byte*)old_ptr - sizeof(Dieq__Block_Header));
+  dieq_uisz old_size = old_header->size - old_header->padding - sizeof(Dieq__Block_Header);
+
+  dieq_uisz smaller_size = old_size < new_size ? old_size : new_size;
+  dieq_mem_cpy(new_ptr, old_ptr, smaller_size);
+}
+
+// Grows or shrinks a block over the free space that follows it, the grown part reads as zeroes
+static bool dieq__heap_resize_in_place(Dieq_Heap *heap, void *ptr, dieq_uisz new_size) {
+  if (!dieq_heap_owns(heap, ptr)) return false;
+  if (new_size > (dieq_uisz)-1 - 2*sizeof(Dieq__Block_Header)) return false;
+
+  dieq_uisz offset = (dieq_uisz)((dieq_byte*)ptr - (dieq_byte*)heap) - sizeof(Dieq__Block_Header);
+  dieq_uisz desired_space = sizeof(Dieq__Block_Header) + new_size;
+  dieq_uisz true_space = dieq__align_forward(desired_space, sizeof(void*));
+  dieq_uisz zero_from = 0, zero_to = 0;
+
+  if (heap->synchronized) dieq__spin_lock(&heap->lock);
+  bool fits = dieq__heap_node_exists(heap, offset);
+  if (fits) {
+    Dieq__Block_Header *header = dieq__heap_block(heap, offset);
+    dieq_uisz limit = header->next ? header->next : heap->size;
+    fits = true_space <= limit - offset;
+    if (fits) {
+      dieq_uisz new_end = offset + true_space;
+      zero_from = offset + header->size - header->padding;
+      zero_to = new_end < heap->clean ? new_end : heap->clean;
+      if (new_end > heap->clean) heap->clean = new_end;
+
+      header->size = true_space;
+      header->padding = true_space - desired_space;
+    }
+  }
+  if (heap->synchronized) dieq__spin_unlock(&heap->lock);
+
+  if (zero_to > zero_from) dieq_mem_set((dieq_byte*)heap + zero_from, 0, zero_to - zero_from);
+  return fits;
+}
+
+void *dieq_heap_realloc(Dieq_Heap *heap, void *old_ptr, dieq_uisz new_size) {
+  if (old_ptr && dieq__heap_resize_in_place(heap, old_ptr, new_size)) return old_ptr;
+
+  void *new_ptr = dieq_heap_alloc(heap, new_size);
+  if (old_ptr == NULL || new_ptr == NULL) return new_ptr;
+
+  dieq__copy_block_contents(new_ptr, old_ptr, new_size);
+  dieq_heap_free(heap, old_ptr);
+
+  return new_ptr;
+}
+
+#ifdef DIEQ__LINUX
+#define DIEQ__MPOL_BIND 2
+#define DIEQ__MPOL_F_MEMS_ALLOWED (1 << 2)
+#define DIEQ__NUMA_MASK_BITS (8*sizeof(unsigned long))
+#define DIEQ__NUMA_MASK_WORDS ((DIEQ_NUMA_MAX_NODES + DIEQ__NUMA_MASK_BITS - 1) / DIEQ__NUMA_MASK_BITS)
+// Allocations a thread makes before asking the kernel again which node it is running on
+#define DIEQ__NUMA_NODE_REFRESH 1024
+
+static struct {
+  Dieq_Heap *heaps[DIEQ_NUMA_MAX_NODES];
+  dieq_uisz region_size;
+  dieq_uisz count;
+} dieq__numa = {0};
+
+static DIEQ__THREAD_LOCAL struct {
+  unsigned int node;
+  unsigned int countdown;
+} dieq__numa_thread = {0};
+
+bool dieq_numa_setup(dieq_uisz bytes_per_node) {
+  if (dieq__numa.count > 0) return false;
+  if (bytes_per_node <= sizeof(Dieq_Heap)) return false;
+
+  unsigned long allowed[DIEQ__NUMA_MASK_WORDS] = {0};
+  unsigned long max_node = (unsigned long)DIEQ_NUMA_MAX_NODES + 1;
+  bool has_policy = syscall(SYS_get_mempolicy, NULL, allowed, max_node, NULL, DIEQ__MPOL_F_MEMS_ALLOWED) == 0;
+  // Kernels built without NUMA support still get a single heap for node 0
+  if (!has_policy) allowed[0] = 1;
+
+  dieq__numa.region_size = dieq__align_forward(bytes_per_node, (dieq_uisz)sysconf(_SC_PAGESIZE));
+  for (dieq_uisz node = 0; node < DIEQ_NUMA_MAX_NODES; ++node) {
+    unsigned long bit = 1UL << (node % DIEQ__NUMA_MASK_BITS);
+    if (!(allowed[node / DIEQ__NUMA_MASK_BITS] & bit)) continue;
+
+    void *region = mmap(NULL, dieq__numa.region_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+      dieq_numa_teardown();
+      return false;
+    }
+
+    if (has_policy) {
+      unsigned long mask[DIEQ__NUMA_MASK_WORDS] = {0};
+      mask[node / DIEQ__NUMA_MASK_BITS] = bit;
+      // Has to happen before the heap header is written, pages land on the node that first touches them.
+      // A failed bind leaves the region usable, just without the placement guarantee.
+      syscall(SYS_mbind, region, dieq__numa.region_size, DIEQ__MPOL_BIND, mask, max_node, 0);
+    }
+
+    Dieq_Heap *heap = dieq_heap_create_zeroed(region, (dieq_byte*)region + dieq__numa.region_size);
+    heap->synchronized = true;
+    dieq__numa.heaps[node] = heap;
+    dieq__numa.count++;
+  }
+
+  return dieq__numa.count > 0;
+}
+
+void dieq_numa_teardown(void) {
+  for (dieq_uisz node = 0; node < DIEQ_NUMA_MAX_NODES; ++node) {
+    if (dieq__numa.heaps[node]) munmap(dieq__numa.heaps[node], dieq__numa.region_size);
+  }
+  dieq_mem_set(&dieq__numa, 0, sizeof(dieq__numa));
+}
+
+dieq_uisz dieq_numa_node_count(void) {
+  return dieq__numa.count;
+}
+
+Dieq_Heap *dieq_numa_heap(dieq_uisz node) {
+  if (node >= DIEQ_NUMA_MAX_NODES) return NULL;
+  return dieq__numa.heaps[node];
+}
+
+static unsigned int dieq__numa_current_node(void) {
+  if (dieq__numa_thread.countdown == 0) {
+    unsigned int cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) dieq__numa_thread.node = node;
+    dieq__numa_thread.countdown = DIEQ__NUMA_NODE_REFRESH;
+  }
+  dieq__numa_thread.countdown--;
+  return dieq__numa_thread.node;
+}
+
+static void *dieq__numa_alloc(dieq_uisz size) {
+  unsigned int local = dieq__numa_current_node();
+  if (local < DIEQ_NUMA_MAX_NODES) {
+    void *ptr = dieq_heap_alloc(dieq__numa.heaps[local], size);
+    if (ptr) return ptr;
+  }
+
+  // The local node is full (or has no heap), remote memory still beats no memory
+  for (dieq_uisz node = 0; node < DIEQ_NUMA_MAX_NODES; ++node) {
+    if (node == local) continue;
+    void *ptr = dieq_heap_alloc(dieq__numa.heaps[node], size);
+    if (ptr) return ptr;
+  }
+
+  return NULL;
+}
+#endif // DIEQ__LINUX
+
+static Dieq_Heap *dieq__heap_of(void *ptr) {
+#ifdef DIEQ__LINUX
+  if (dieq__numa.count > 0) {
+    for (dieq_uisz node = 0; node < DIEQ_NUMA_MAX_NODES; ++node) {
+      if (dieq_heap_owns(dieq__numa.heaps[node], ptr)) return dieq__numa.heaps[node];
+    }
+  }
+#else
+  (void)ptr;
+#endif // DIEQ__LINUX
+  return dieq__global_heap;
+}
+
+// Setup never touches the region past the heap header, blocks get cleared as dieq_alloc hands
+// them out. That keeps setup O(1) and leaves the pages nobody allocated from out of the RSS.
+static void dieq__global_setup(void *start, void *end, bool zeroed) {
+  Dieq_Heap *heap = dieq__global_heap;
+  if (heap != NULL && (dieq_uisz)heap == dieq__align_forward((dieq_uisz)start, sizeof(void*))) {
+    // A zeroed tail extends the clean range as is, otherwise nothing past the new end is known
+    heap->size = (dieq_uisz)((dieq_byte*)end - (dieq_byte*)heap);
+    if (!zeroed) heap->clean = heap->size;
+    return;
+  }
+
+  dieq__global_heap = zeroed ? dieq_heap_create_zeroed(start, end) : dieq_heap_create(start, end);
+}
+
+void dieq_global_setup(void *start, void *end) {
+  dieq__global_setup(start, end, false);
+}
+
+void dieq_global_setup_zeroed(void *start, void *end) {
+  dieq__global_setup(start, end, true);
+}
+
+void *dieq_alloc(dieq_uisz size) {
+#ifdef DIEQ__LINUX
+  if (dieq__numa.count > 0) return dieq__numa_alloc(size);
+#endif // DIEQ__LINUX
+  return dieq_heap_alloc(dieq__global_heap, size);
+}
+
+// dieq_alloc without clearing the block, for memory nobody promised to be zero. Node heaps are
+// mapped zeroed and never clear their fresh part anyway.
+static void *dieq__alloc_uninit(dieq_uisz size) {
+#ifdef DIEQ__LINUX
+  if (dieq__numa.count > 0) return dieq__numa_alloc(size);
+#endif // DIEQ__LINUX
+  return dieq__heap_alloc(dieq__global_heap, size, sizeof(void*), false);
+}
+
+void dieq_free(void *ptr) {
+  dieq_heap_free(dieq__heap_of(ptr), ptr);
+}
+
+void *dieq_realloc(void *old_ptr, dieq_uisz new_size) {
+  if (old_ptr && dieq__heap_resize_in_place(dieq__heap_of(old_ptr), old_ptr, new_size)) return old_ptr;
+
+  void *new_ptr = dieq_alloc(new_size);
+  if (old_ptr == NULL || new_ptr == NULL) return new_ptr;
+
+  dieq__copy_block_contents(new_ptr, old_ptr, new_size);
+  dieq_free(old_ptr);
+
+  return new_ptr;
+}
+
+#ifndef DIEQ__LINUX
+// Scratch and recycled arenas live on the global heap off Linux, and every thread creates and
+// grows its own. These take the heap lock even when the heap is not synchronized, which keeps
+// those threads from racing each other. Plain dieq_alloc calls from other threads still need a
+// synchronized global heap.
+static void *dieq__global_alloc_locked(dieq_uisz size) {
+  Dieq_Heap *heap = dieq__global_heap;
+  if (heap == NULL || heap->synchronized) return dieq_alloc(size);
+
+  dieq__spin_lock(&heap->lock);
+  void *ptr = dieq_heap_alloc(heap, size);
+  dieq__spin_unlock(&heap->lock);
+  return ptr;
+}
+
+static void dieq__global_free_locked(void *ptr) {
+  Dieq_Heap *heap = dieq__global_heap;
+  if (heap == NULL || heap->synchronized) {
+    dieq_free(ptr);
+    return;
+  }
+
+  dieq__spin_lock(&heap->lock);
+  dieq_heap_free(heap, ptr);
+  dieq__spin_unlock(&heap->lock);
+}
+
+static const Dieq_Allocator dieq__global_allocator_locked = {
+  .alloc = dieq__global_alloc_locked,
+  .free = dieq__global_free_locked,
+};
+#endif // DIEQ__LINUX
+
+static void *dieq__heap_ctx_alloc(void *ctx, dieq_uisz size, dieq_uisz align) {
+  return dieq_heap_alloc_aligned((Dieq_Heap*)ctx, size, align);
+}
+
+static void *dieq__heap_ctx_resize(void *ctx, void *ptr, dieq_uisz old_size, dieq_uisz new_size, dieq_uisz align) {
+  Dieq_Heap *heap = (Dieq_Heap*)ctx;
+  if (ptr == NULL) return dieq_heap_alloc_aligned(heap, new_size, align);
+  if (dieq__heap_resize_in_place(heap, ptr, new_size)) return ptr;
+
+  void *new_ptr = dieq_heap_alloc_aligned(heap, new_size, align);
+  if (new_ptr == NULL) return NULL;
+  dieq_mem_cpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  dieq_heap_free(heap, ptr);
+  return new_ptr;
+}
+
+static void dieq__heap_ctx_free(void *ctx, void *ptr, dieq_uisz size) {
+  (void)size;
+  dieq_heap_free((Dieq_Heap*)ctx, ptr);
+}
+
+Dieq_Ctx_Allocator dieq_heap_ctx_allocator(Dieq_Heap *heap) {
+  Dieq_Ctx_Allocator allocator = {
+    .ctx = heap,
+    .alloc = dieq__heap_ctx_alloc,
+    .resize = dieq__heap_ctx_resize,
+    .free = dieq__heap_ctx_free,
+  };
+  return allocator;
+}
+
+void dieq_heap_set_root(Dieq_Heap *heap, void *root) {
+  heap->root = root ? (dieq_uisz)((dieq_byte*)root - (dieq_byte*)heap) : 0;
+}
+
+void *dieq_heap_get_root(Dieq_Heap *heap) {
+  return heap->root ? (dieq_byte*)heap + heap->root : NULL;
+}
+
+dieq_uisz dieq_heap_offset_of(Dieq_Heap *heap, void *ptr) {
+  if (ptr == NULL) return 0;
+  return (dieq_uisz)((dieq_byte*)ptr - (dieq_byte*)heap);
+}
+
+void *dieq_heap_at(Dieq_Heap *heap, dieq_uisz offset) {
+  if (offset == 0 || offset >= heap->size) return NULL;
+  return (dieq_byte*)heap + offset;
+}
+
+#ifdef DIEQ__LINUX
+// Heaps this process mapped itself. Kept outside of the heaps, so a copy of a heap image never
+// passes for the mapping it was taken from.
+typedef struct {
+  Dieq_Heap *heap;
+  dieq_uisz size;
+} Dieq__Heap_Mapping;
+
+static Dieq__Heap_Mapping dieq__heap_mappings[DIEQ_HEAP_MAX_MAPPINGS];
+static unsigned int dieq__heap_mappings_lock;
+
+static bool dieq__heap_track_mapping(Dieq_Heap *heap, dieq_uisz size) {
+  bool tracked = false;
+  dieq__spin_lock(&dieq__heap_mappings_lock);
+  for (dieq_uisz i = 0; i < DIEQ_HEAP_MAX_MAPPINGS && !tracked; ++i) {
+    if (dieq__heap_mappings[i].heap) continue;
+    dieq__heap_mappings[i].heap = heap;
+    dieq__heap_mappings[i].size = size;
+    tracked = true;
+  }
+  dieq__spin_unlock(&dieq__heap_mappings_lock);
+  return tracked;
+}
+
+// Size of the mapping `heap` starts, 0 when this process did not map it. `forget` drops it.
+static dieq_uisz dieq__heap_find_mapping(Dieq_Heap *heap, bool forget) {
+  if (heap == NULL) return 0;
+
+  dieq_uisz size = 0;
+  dieq__spin_lock(&dieq__heap_mappings_lock);
+  for (dieq_uisz i = 0; i < DIEQ_HEAP_MAX_MAPPINGS; ++i) {
+    if (dieq__heap_mappings[i].heap != heap) continue;
+    size = dieq__heap_mappings[i].size;
+    if (forget) dieq__heap_mappings[i].heap = NULL;
+    break;
+  }
+  dieq__spin_unlock(&dieq__heap_mappings_lock);
+  return size;
+}
+
+// Maps the heap stored in `fd`, creating one of `size` bytes when the file is still empty. Only a
+// heap created here takes `synchronized`, existing ones keep whatever their header says.
+static Dieq_Heap *dieq__heap_map_fd(int fd, dieq_uisz size, bool synchronized) {
+  struct stat st;
+  if (fstat(fd, &st) < 0) return NULL;
+
+  if (st.st_size == 0) {
+    if (size <= sizeof(Dieq_Heap)) return NULL;
+    // Sparse file, so the fresh heap reads as zeroes and costs nothing until blocks get written
+    if (ftruncate(fd, (off_t)size) < 0) return NULL;
+    void *map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return NULL;
+    if (!dieq__heap_track_mapping(map, size)) {
+      munmap(map, size);
+      return NULL;
+    }
+
+    // Other processes can open the file already, it has to be complete before the magic shows up
+    Dieq_Heap *heap = dieq__heap_init(map, (dieq_byte*)map + size);
+    heap->clean = dieq__heap_first_block();
+    heap->synchronized = synchronized;
+    return dieq__heap_publish(heap);
+  }
+
+  // Heaps are created to fill their file exactly, any other size means it was cut or grown since
+  Dieq_Heap image;
+  if (pread(fd, &image, sizeof(image), 0) != (ssize_t)sizeof(image)) return NULL;
+  if (dieq_heap_attach(&image) == NULL || image.size <= sizeof(Dieq_Heap) || (off_t)image.size != st.st_size) return NULL;
+
+  Dieq_Heap *heap = mmap(NULL, image.size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (heap == MAP_FAILED) return NULL;
+  if (!dieq__heap_track_mapping(heap, image.size)) {
+    munmap(heap, image.size);
+    return NULL;
+  }
+
+  return heap;
+}
+
+Dieq_Heap *dieq_heap_open_file(const char *path, dieq_uisz size) {
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return NULL;
+
+  Dieq_Heap *heap = dieq__heap_map_fd(fd, size, false);
+  // Whoever held the lock when the image was last written is gone now
+  if (heap) heap->lock = 0;
+
+  close(fd);
+  return heap;
+}
+
+bool dieq_heap_checkpoint(Dieq_Heap *heap) {
+  dieq_uisz size = dieq__heap_find_mapping(heap, false);
+  if (size == 0) return false;
+  return msync(heap, size, MS_SYNC) == 0;
+}
+
+void dieq_heap_close_file(Dieq_Heap *heap) {
+  dieq_uisz size = dieq__heap_find_mapping(heap, true);
+  if (size == 0) return;
+  if (heap == dieq__global_heap) dieq__global_heap = NULL;
+  munmap(heap, size);
+}
+
+bool dieq_global_setup_file(const char *path, dieq_uisz size) {
+  Dieq_Heap *heap = dieq_heap_open_file(path, size);
+  if (heap == NULL) return false;
+
+  dieq__global_heap = heap;
+  return true;
+}
+
+Dieq_Heap *dieq_heap_create_shared(const char *name, dieq_uisz size) {
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) return NULL;
+
+  Dieq_Heap *heap = dieq__heap_map_fd(fd, size, true);
+  close(fd);
+  if (heap == NULL) shm_unlink(name);
+  return heap;
+}
+
+Dieq_Heap *dieq_heap_open_shared(const char *name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) return NULL;
+
+  Dieq_Heap *heap = dieq__heap_map_fd(fd, 0, false);
+  close(fd);
+  return heap;
+}
+
+bool dieq_heap_unlink_shared(const char *name) {
+  return shm_unlink(name) == 0;
+}
+
+Dieq_Heap *dieq_heap_create_memfd(dieq_uisz size, int *fd) {
+  // No close-on-exec, the descriptor is meant to reach other processes
+  int memfd = (int)syscall(SYS_memfd_create, "dieq-heap", 0);
+  if (memfd < 0) return NULL;
+
+  Dieq_Heap *heap = dieq__heap_map_fd(memfd, size, true);
+  if (heap == NULL) {
+    close(memfd);
+    return NULL;
+  }
+
+  *fd = memfd;
+  return heap;
+}
+
+Dieq_Heap *dieq_heap_open_fd(int fd) {
+  return dieq__heap_map_fd(fd, 0, false);
+}
+#endif // DIEQ__LINUX
+
+void dieq__no_op_allocator_free(void *data) {
+  (void)data;
+}
+
+// Backing memory of arenas and pools, the context allocator wins when both are set. Only the
+// context allocator can honour `align`, plain ones hand out pointer aligned memory.
+static void *dieq__backing_alloc(Dieq_Allocator *allocator, Dieq_Ctx_Allocator *ctx_allocator, dieq_uisz size, dieq_uisz align) {
+  if (ctx_allocator->alloc) return ctx_allocator->alloc(ctx_allocator->ctx, size, align);
+  return allocator->alloc(size);
+}
+
+static void dieq__backing_free(Dieq_Allocator *allocator, Dieq_Ctx_Allocator *ctx_allocator, void *ptr, dieq_uisz size) {
+  if (ctx_allocator->free) {
+    ctx_allocator->free(ctx_allocator->ctx, ptr, size);
+    return;
+  }
+  allocator->free(ptr);
+}
+
+bool dieq_arena_init(Dieq_Arena *arena, dieq_uisz capacity) {
+  void *buf = dieq_alloc(capacity);
+  if (buf == NULL) return false;
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  arena->buf = buf;
+  arena->cap = capacity;
+  arena->allocator.alloc = dieq_alloc;
+  arena->allocator.free = dieq_free;
+
+  return true;
+}
+
+
+bool dieq_arena_init_with_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
+
+  void *buf = allocator.alloc(capacity);
+  if (buf == NULL) return false;
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  arena->buf = buf;
+  arena->cap = capacity;
+  arena->allocator = allocator;
+
+  return true;
+}
+
+bool dieq_arena_init_with_ctx_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Ctx_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
+
+  void *buf = allocator.alloc(allocator.ctx, capacity, sizeof(void*));
+  if (buf == NULL) return false;
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  arena->buf = buf;
+  arena->cap = capacity;
+  arena->ctx_allocator = allocator;
+
+  return true;
+}
+
+bool dieq_arena_init_from_buffer(Dieq_Arena *arena, void *buf, dieq_uisz buf_len) {
+  if (buf == NULL || buf_len == 0) return false;
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  arena->buf = buf;
+  arena->cap = buf_len;
+  arena->allocator.free = dieq__no_op_allocator_free;
+
+  return true;
+}
+
+struct Dieq__Arena_Block {
+  Dieq__Arena_Block *prev;
+  Dieq__Arena_Block *next;
+  dieq_uisz cap;
+  dieq_uisz base; // Save point of the first byte in the block
+};
+
+static inline void dieq__arena_enter_block(Dieq_Arena *arena, Dieq__Arena_Block *block) {
+  arena->block = block;
+  arena->buf = (dieq_byte*)(block + 1);
+  arena->cap = block->cap;
+}
+
+bool dieq_arena_init_growable(Dieq_Arena *arena, dieq_uisz capacity) {
+  Dieq_Allocator allocator = { .alloc = dieq_alloc, .free = dieq_free };
+  return dieq_arena_init_growable_with_allocator(arena, capacity, allocator);
+}
+
+static bool dieq__arena_init_growable(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator, Dieq_Ctx_Allocator ctx_allocator) {
+  if (capacity == 0) return false;
+  if (capacity > (dieq_uisz)-1 - sizeof(Dieq__Arena_Block)) return false;
+
+  Dieq__Arena_Block *block = dieq__backing_alloc(&allocator, &ctx_allocator, sizeof(Dieq__Arena_Block) + capacity, sizeof(void*));
+  if (block == NULL) return false;
+  dieq_mem_set(block, 0, sizeof(*block));
+  block->cap = capacity;
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  arena->allocator = allocator;
+  arena->ctx_allocator = ctx_allocator;
+  dieq__arena_enter_block(arena, block);
+
+  return true;
+}
+
+bool dieq_arena_init_growable_with_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
+
+  Dieq_Ctx_Allocator none = {0};
+  return dieq__arena_init_growable(arena, capacity, allocator, none);
+}
+
+bool dieq_arena_init_growable_with_ctx_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Ctx_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
+
+  Dieq_Allocator none = {0};
+  return dieq__arena_init_growable(arena, capacity, none, allocator);
+}
+
+// Moves a growable arena into the block after the current one, chaining a new one if needed
+static bool dieq__arena_next_block(Dieq_Arena *arena, dieq_uisz size) {
+  Dieq__Arena_Block *current = arena->block;
+  Dieq__Arena_Block *next = current->next;
+
+  // Kept blocks too small for this allocation are dropped, whatever replaces them is bigger
+  while (next && next->cap < size) {
+    Dieq__Arena_Block *after = next->next;
+    dieq__backing_free(&arena->allocator, &arena->ctx_allocator, next, sizeof(Dieq__Arena_Block) + next->cap);
+    next = after;
+  }
+
+  if (next == NULL) {
+    dieq_uisz cap = current->cap < (dieq_uisz)-1/2 ? current->cap*2 : current->cap;
+    if (cap < size) cap = size;
+    if (cap > (dieq_uisz)-1 - sizeof(Dieq__Arena_Block)) return false;
+
+    next = dieq__backing_alloc(&arena->allocator, &arena->ctx_allocator, sizeof(Dieq__Arena_Block) + cap, sizeof(void*));
+    if (next == NULL) {
+      current->next = NULL;
+      return false;
+    }
+    next->cap = cap;
+    next->next = NULL;
+  }
+
+  next->prev = current;
+  next->base = current->base + current->cap;
+  current->next = next;
+  if (next->next) next->next->prev = next;
+
+  dieq__arena_enter_block(arena, next);
+  arena->idx = 0;
+  return true;
+}
+
+#ifdef DIEQ__LINUX
+bool dieq_arena_init_virtual(Dieq_Arena *arena, dieq_uisz reserve) {
+  if (reserve == 0) return false;
+  if (reserve > (dieq_uisz)-1 - DIEQ_ARENA_COMMIT_SIZE) return false;
+  reserve = dieq__align_forward(reserve, DIEQ_ARENA_COMMIT_SIZE);
+
+  void *buf = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (buf == MAP_FAILED) return false;
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  arena->buf = buf;
+  arena->cap = reserve;
+  arena->reserved = true;
+
+  return true;
+}
+
+static bool dieq__arena_commit(Dieq_Arena *arena, dieq_uisz end) {
+  dieq_uisz target = dieq__align_forward(end, DIEQ_ARENA_COMMIT_SIZE);
+  if (target > arena->cap) target = arena->cap;
+  if (mprotect(arena->buf + arena->committed, target - arena->committed, PROT_READ|PROT_WRITE) < 0) return false;
+  arena->committed = target;
+  return true;
+}
+#endif // DIEQ__LINUX
+
+// Drops the whole pages between `start` and `end`, whatever they held is lost. The arena must have
+// the memory to itself, and without an OS to give the pages back to nothing happens.
+static void dieq__arena_release_pages(dieq_byte *start, dieq_byte *end) {
+#ifdef DIEQ__LINUX
+  dieq_uisz page = (dieq_uisz)sysconf(_SC_PAGESIZE);
+  dieq_uisz from = dieq__align_forward((dieq_uisz)start, page);
+  dieq_uisz to = (dieq_uisz)end & ~(page - 1);
+  if (to > from) madvise((void*)from, to - from, MADV_DONTNEED);
+#else
+  (void)start;
+  (void)end;
+#endif // DIEQ__LINUX
+}
+
+void dieq_arena_restore_point_decommit(Dieq_Arena *arena, dieq_uisz save_point, dieq_uisz retain) {
+  dieq_arena_restore_point(arena, save_point);
+
+  dieq_uisz keep = arena->cap;
+  if (retain < arena->cap - arena->idx) keep = arena->idx + retain;
+
+#ifdef DIEQ__LINUX
+  if (arena->reserved) {
+    keep = dieq__align_forward(keep, DIEQ_ARENA_COMMIT_SIZE);
+    if (keep >= arena->committed) return;
+
+    dieq_byte *excess = arena->buf + keep;
+    madvise(excess, arena->committed - keep, MADV_DONTNEED);
+    mprotect(excess, arena->committed - keep, PROT_NONE);
+    arena->committed = keep;
+    return;
+  }
+#endif // DIEQ__LINUX
+
+  // Only a buffer from the allocator of the arena is known to hold nothing else past `idx`
+  bool owned = arena->allocator.alloc != NULL || arena->ctx_allocator.alloc != NULL;
+  if (owned) dieq__arena_release_pages(arena->buf + keep, arena->buf + arena->cap);
+
+  if (arena->block) {
+    // Kept blocks only keep pages for what is left of `retain` once the current block is counted,
+    // the ones it doesn't reach at all go back to the allocator
+    dieq_uisz budget = keep < arena->cap ? 0 : retain - (arena->cap - arena->idx);
+    Dieq__Arena_Block *last = arena->block;
+    while (budget > 0 && last->next) {
+      last = last->next;
+      dieq_uisz kept = budget < last->cap ? budget : last->cap;
+      dieq__arena_release_pages((dieq_byte*)(last + 1) + kept, (dieq_byte*)(last + 1) + last->cap);
+      budget -= kept;
+    }
+
+    Dieq__Arena_Block *block = last->next;
+    last->next = NULL;
+    while (block) {
+      Dieq__Arena_Block *next = block->next;
+      dieq__backing_free(&arena->allocator, &arena->ctx_allocator, block, sizeof(Dieq__Arena_Block) + block->cap);
+      block = next;
+    }
+  }
+}
+
+void dieq_arena_reset_decommit(Dieq_Arena *arena, dieq_uisz retain) {
+  dieq_arena_restore_point_decommit(arena, 0, retain);
+}
+
+static inline void dieq__arena_track_peak(Dieq_Arena *arena) {
+  dieq_uisz position = (arena->block ? arena->block->base : 0) + arena->idx;
+  if (position > arena->stats.peak) arena->stats.peak = position;
+}
+
+void *dieq_arena_alloc_aligned(Dieq_Arena *arena, dieq_uisz size, dieq_uisz align) {
+  if (align == 0 || (align & (align - 1)) != 0) return NULL;
+
+  dieq_uisz addr = (dieq_uisz)(arena->buf + arena->idx);
+  dieq_uisz padding = dieq__align_forward(addr, align) - addr;
+  dieq_uisz available = arena->cap - arena->idx;
+  if (padding > available || size > available - padding) {
+    // Room for the worst case padding, the start of the next block may be aligned to anything
+    if (arena->block == NULL || size > (dieq_uisz)-1 - align || !dieq__arena_next_block(arena, size + align - 1)) {
+      arena->stats.failures += 1;
+      return NULL;
+    }
+
+    addr = (dieq_uisz)arena->buf;
+    padding = dieq__align_forward(addr, align) - addr;
+  }
+
+  dieq_uisz offset = arena->idx + padding;
+#ifdef DIEQ__LINUX
+  if (arena->reserved && offset + size > arena->committed) {
+    if (!dieq__arena_commit(arena, offset + size)) {
+      arena->stats.failures += 1;
+      return NULL;
+    }
+  }
+#endif // DIEQ__LINUX
+  arena->idx = offset + size;
+  arena->stats.allocs += 1;
+  arena->stats.waste += padding;
+  dieq__arena_track_peak(arena);
+  return arena->buf + offset;
+}
+
+void *dieq_arena_alloc(Dieq_Arena *arena, dieq_uisz size) {
+  return dieq_arena_alloc_aligned(arena, size, sizeof(void*));
+}
+
+void *dieq_arena_alloc_array_aligned(Dieq_Arena *arena, dieq_uisz count, dieq_uisz item_size, dieq_uisz align) {
+  if (item_size != 0 && count > (dieq_uisz)-1 / item_size) return NULL;
+  return dieq_arena_alloc_aligned(arena, count * item_size, align);
+}
+
+void *dieq_arena_alloc_array(Dieq_Arena *arena, dieq_uisz count, dieq_uisz item_size) {
+  return dieq_arena_alloc_array_aligned(arena, count, item_size, sizeof(void*));
+}
+
+bool dieq_arena_extend(Dieq_Arena *arena, void *ptr, dieq_uisz old_size, dieq_uisz new_size) {
+  dieq_uisz start = (dieq_uisz)arena->buf;
+  dieq_uisz p = (dieq_uisz)ptr;
+  if (p < start || p - start > arena->idx || arena->idx - (p - start) != old_size) return false;
+
+  dieq_uisz offset = p - start;
+  if (new_size > arena->cap - offset) {
+    arena->stats.failures += 1;
+    return false;
+  }
+#ifdef DIEQ__LINUX
+  if (arena->reserved && offset + new_size > arena->committed) {
+    if (!dieq__arena_commit(arena, offset + new_size)) {
+      arena->stats.failures += 1;
+      return false;
+    }
+  }
+#endif // DIEQ__LINUX
+  arena->idx = offset + new_size;
+  dieq__arena_track_peak(arena);
+  return true;
+}
+
+void *dieq_arena_realloc(Dieq_Arena *arena, void *ptr, dieq_uisz old_size, dieq_uisz new_size) {
+  if (ptr == NULL) return dieq_arena_alloc(arena, new_size);
+  if (dieq_arena_extend(arena, ptr, old_size, new_size)) return ptr;
+  // Shrinking something buried under later allocations, it just keeps its old room
+  if (new_size <= old_size) return ptr;
+
+  void *new_ptr = dieq_arena_alloc(arena, new_size);
+  if (new_ptr == NULL) return NULL;
+  dieq_mem_cpy(new_ptr, ptr, old_size);
+  return new_ptr;
+}
+
+static void *dieq__arena_ctx_alloc(void *ctx, dieq_uisz size, dieq_uisz align) {
+  return dieq_arena_alloc_aligned((Dieq_Arena*)ctx, size, align);
+}
+
+static void *dieq__arena_ctx_resize(void *ctx, void *ptr, dieq_uisz old_size, dieq_uisz new_size, dieq_uisz align) {
+  Dieq_Arena *arena = (Dieq_Arena*)ctx;
+  if (ptr == NULL) return dieq_arena_alloc_aligned(arena, new_size, align);
+  if (dieq_arena_extend(arena, ptr, old_size, new_size)) return ptr;
+  if (new_size <= old_size) return ptr;
+
+  void *new_ptr = dieq_arena_alloc_aligned(arena, new_size, align);
+  if (new_ptr == NULL) return NULL;
+  dieq_mem_cpy(new_ptr, ptr, old_size);
+  return new_ptr;
+}
+
+static void dieq__arena_ctx_free(void *ctx, void *ptr, dieq_uisz size) {
+  dieq_arena_extend((Dieq_Arena*)ctx, ptr, size, 0);
+}
+
+Dieq_Ctx_Allocator dieq_arena_ctx_allocator(Dieq_Arena *arena) {
+  Dieq_Ctx_Allocator allocator = {
+    .ctx = arena,
+    .alloc = dieq__arena_ctx_alloc,
+    .resize = dieq__arena_ctx_resize,
+    .free = dieq__arena_ctx_free,
+  };
+  return allocator;
+}
+
+dieq_uisz dieq_arena_save_point(Dieq_Arena *arena) {
+  dieq_uisz base = arena->block ? arena->block->base : 0;
+  return base + arena->idx;
+}
+
+void dieq_arena_restore_point(Dieq_Arena *arena, dieq_uisz save_point) {
+  // Walk back to the block the save point was taken in, the ones after it stay chained for reuse
+  while (arena->block && save_point < arena->block->base && arena->block->prev) {
+    dieq__arena_enter_block(arena, arena->block->prev);
+  }
+  arena->idx = save_point - (arena->block ? arena->block->base : 0);
+}
+
+Dieq_Arena_Stats dieq_arena_stats(Dieq_Arena *arena) {
+  return arena->stats;
+}
+
+void dieq_arena_reset_stats(Dieq_Arena *arena) {
+  dieq_mem_set(&arena->stats, 0, sizeof(arena->stats));
+  arena->stats.peak = dieq_arena_save_point(arena);
+}
+
+static unsigned int dieq__arena_registry_lock;
+static Dieq_Arena *dieq__arena_registry;
+
+void dieq_arena_register(Dieq_Arena *arena, const char *name) {
+  dieq__spin_lock(&dieq__arena_registry_lock);
+  arena->name = name;
+  if (!arena->registered) {
+    arena->registered = true;
+    arena->registry_prev = NULL;
+    arena->registry_next = dieq__arena_registry;
+    if (dieq__arena_registry) dieq__arena_registry->registry_prev = arena;
+    dieq__arena_registry = arena;
+  }
+  dieq__spin_unlock(&dieq__arena_registry_lock);
+}
+
+void dieq_arena_unregister(Dieq_Arena *arena) {
+  // Only the owner of the arena changes `registered`, every deinit of an arena that was never
+  // registered gets by without the global lock
+  if (!arena->registered) return;
+
+  dieq__spin_lock(&dieq__arena_registry_lock);
+  if (arena->registry_prev) arena->registry_prev->registry_next = arena->registry_next;
+  else dieq__arena_registry = arena->registry_next;
+  if (arena->registry_next) arena->registry_next->registry_prev = arena->registry_prev;
+  arena->registry_prev = NULL;
+  arena->registry_next = NULL;
+  arena->registered = false;
+  dieq__spin_unlock(&dieq__arena_registry_lock);
+}
+
+void dieq_arena_registry_foreach(Dieq_Arena_Visit visit, void *user) {
+  dieq__spin_lock(&dieq__arena_registry_lock);
+  for (Dieq_Arena *arena = dieq__arena_registry; arena; arena = arena->registry_next) {
+    visit(arena, user);
+  }
+  dieq__spin_unlock(&dieq__arena_registry_lock);
+}
+
+bool dieq_arena_deinit(Dieq_Arena *arena) {
+  if (arena->block) {
+    Dieq__Arena_Block *block = arena->block;
+    while (block->prev) block = block->prev;
+    while (block) {
+      Dieq__Arena_Block *next = block->next;
+      dieq__backing_free(&arena->allocator, &arena->ctx_allocator, block, sizeof(Dieq__Arena_Block) + block->cap);
+      block = next;
+    }
+#ifdef DIEQ__LINUX
+  } else if (arena->reserved) {
+    munmap(arena->buf, arena->cap);
+#endif // DIEQ__LINUX
+  } else if (arena->buf) {
+    if (arena->allocator.free == NULL && arena->ctx_allocator.free == NULL) return false;
+    dieq__backing_free(&arena->allocator, &arena->ctx_allocator, arena->buf, arena->cap);
+  }
+
+  dieq_arena_unregister(arena);
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  return true;
+}
+
+static DIEQ__THREAD_LOCAL Dieq_Arena dieq__scratch[DIEQ_SCRATCH_COUNT] = {0};
+
+Dieq_Scratch dieq_scratch_begin(Dieq_Arena **conflicts, dieq_uisz conflicts_count) {
+  Dieq_Scratch scratch = {0};
+
+  for (dieq_uisz i = 0; i < DIEQ_SCRATCH_COUNT; ++i) {
+    Dieq_Arena *arena = &dieq__scratch[i];
+    bool conflict = false;
+    for (dieq_uisz j = 0; j < conflicts_count && !conflict; ++j) {
+      conflict = conflicts[j] == arena;
+    }
+    if (conflict) continue;
+
+    if (arena->buf == NULL) {
+#ifdef DIEQ__LINUX
+      if (!dieq_arena_init_virtual(arena, DIEQ_SCRATCH_SIZE)) return scratch;
+#else
+      if (!dieq_arena_init_growable_with_allocator(arena, DIEQ_SCRATCH_SIZE, dieq__global_allocator_locked)) return scratch;
+#endif // DIEQ__LINUX
+    }
+
+    scratch.arena = arena;
+    scratch.save_point = dieq_arena_save_point(arena);
+    return scratch;
+  }
+
+  return scratch;
+}
+
+void dieq_scratch_end(Dieq_Scratch scratch) {
+  if (scratch.arena) dieq_arena_restore_point(scratch.arena, scratch.save_point);
+}
+
+void dieq_scratch_release_thread(void) {
+  for (dieq_uisz i = 0; i < DIEQ_SCRATCH_COUNT; ++i) {
+    dieq_arena_deinit(&dieq__scratch[i]);
+  }
+}
+
+bool dieq_dual_arena_init(Dieq_Dual_Arena *arena, dieq_uisz capacity) {
+  Dieq_Allocator allocator = {
+    .alloc = dieq_alloc,
+    .free = dieq_free,
+  };
+  return dieq_dual_arena_init_with_allocator(arena, capacity, allocator);
+}
+
+bool dieq_dual_arena_init_with_allocator(Dieq_Dual_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
+
+  void *buf = allocator.alloc(capacity);
+  if (buf == NULL) return false;
+
+  arena->buf = buf;
+  arena->bottom = 0;
+  arena->top = capacity;
+  arena->cap = capacity;
+  arena->allocator = allocator;
+
+  return true;
+}
+
+bool dieq_dual_arena_init_from_buffer(Dieq_Dual_Arena *arena, void *buf, dieq_uisz buf_len) {
+  if (buf == NULL) return false;
+
+  arena->buf = buf;
+  arena->bottom = 0;
+  arena->top = buf_len;
+  arena->cap = buf_len;
+  arena->allocator.alloc = NULL;
+  arena->allocator.free = dieq__no_op_allocator_free;
+
+  return true;
+}
+
+bool dieq_dual_arena_deinit(Dieq_Dual_Arena *arena) {
+  if (arena->buf) {
+    if (arena->allocator.free == NULL) return false;
+    arena->allocator.free(arena->buf);
+  }
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  return true;
+}
+
+void *dieq_dual_arena_alloc_bottom_aligned(Dieq_Dual_Arena *arena, dieq_uisz size, dieq_uisz align) {
+  if (align == 0 || (align & (align - 1)) != 0) return NULL;
+
+  dieq_uisz addr = (dieq_uisz)(arena->buf + arena->bottom);
+  dieq_uisz padding = dieq__align_forward(addr, align) - addr;
+  dieq_uisz available = arena->top - arena->bottom;
+  if (padding > available || size > available - padding) return NULL;
+
+  dieq_uisz offset = arena->bottom + padding;
+  arena->bottom = offset + size;
+  return arena->buf + offset;
+}
+
+void *dieq_dual_arena_alloc_bottom(Dieq_Dual_Arena *arena, dieq_uisz size) {
+  return dieq_dual_arena_alloc_bottom_aligned(arena, size, sizeof(void*));
+}
+
+void *dieq_dual_arena_alloc_top_aligned(Dieq_Dual_Arena *arena, dieq_uisz size, dieq_uisz align) {
+  if (align == 0 || (align & (align - 1)) != 0) return NULL;
+  if (size > arena->top - arena->bottom) return NULL;
+
+  // The top end grows down, so the padding goes between the allocation and what sits above it
+  dieq_uisz addr = (dieq_uisz)(arena->buf + arena->top) - size;
+  dieq_uisz padding = addr & (align - 1);
+  if (padding > arena->top - arena->bottom - size) return NULL;
+
+  arena->top -= size + padding;
+  return arena->buf + arena->top;
+}
+
+void *dieq_dual_arena_alloc_top(Dieq_Dual_Arena *arena, dieq_uisz size) {
+  return dieq_dual_arena_alloc_top_aligned(arena, size, sizeof(void*));
+}
+
+dieq_uisz dieq_dual_arena_save_bottom(Dieq_Dual_Arena *arena) {
+  return arena->bottom;
+}
+
+void dieq_dual_arena_restore_bottom(Dieq_Dual_Arena *arena, dieq_uisz save_point) {
+  arena->bottom = save_point;
+}
+
+dieq_uisz dieq_dual_arena_save_top(Dieq_Dual_Arena *arena) {
+  return arena->top;
+}
+
+void dieq_dual_arena_restore_top(Dieq_Dual_Arena *arena, dieq_uisz save_point) {
+  arena->top = save_point;
+}
+
+bool dieq_atomic_arena_init(Dieq_Atomic_Arena *arena, dieq_uisz capacity, dieq_uisz chunk_size) {
+  Dieq_Allocator allocator = {
+    .alloc = dieq_alloc,
+    .free = dieq_free,
+  };
+  return dieq_atomic_arena_init_with_allocator(arena, capacity, chunk_size, allocator);
+}
+
+bool dieq_atomic_arena_init_with_allocator(Dieq_Atomic_Arena *arena, dieq_uisz capacity, dieq_uisz chunk_size, Dieq_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
+
+  void *buf = allocator.alloc(capacity);
+  if (buf == NULL) return false;
+
+  if (!dieq_atomic_arena_init_from_buffer(arena, buf, capacity, chunk_size)) {
+    allocator.free(buf);
+    return false;
+  }
+  arena->allocator = allocator;
+
+  return true;
+}
+
+bool dieq_atomic_arena_init_from_buffer(Dieq_Atomic_Arena *arena, void *buf, dieq_uisz buf_len, dieq_uisz chunk_size) {
+  if (buf == NULL) return false;
+  if (chunk_size == 0) return false;
+
+  // Claims are multiples of a pointer, so they stay aligned once the first one starts aligned
+  dieq_uisz start = dieq__align_forward((dieq_uisz)buf, sizeof(void*)) - (dieq_uisz)buf;
+  if (start > buf_len) return false;
+
+  arena->buf = buf;
+  arena->start = start;
+  arena->idx = start;
+  arena->cap = buf_len;
+  arena->chunk_size = dieq__align_forward(chunk_size, sizeof(void*));
+  arena->generation = 1;
+  arena->allocator.alloc = NULL;
+  arena->allocator.free = dieq__no_op_allocator_free;
+
+  return true;
+}
+
+bool dieq_atomic_arena_deinit(Dieq_Atomic_Arena *arena) {
+  if (arena->buf) {
+    if (arena->allocator.free == NULL) return false;
+    arena->allocator.free(arena->buf);
+  }
+
+  dieq_mem_set(arena, 0, sizeof(*arena));
+  return true;
+}
+
+// Claims `size` bytes of the shared buffer and returns their offset, or `cap` when they don't fit
+static dieq_uisz dieq__atomic_arena_claim(Dieq_Atomic_Arena *arena, dieq_uisz size) {
+  // Failed claims still move `idx`, checking first keeps it from creeping toward an overflow
+  if (size > arena->cap || __atomic_load_n(&arena->idx, __ATOMIC_RELAXED) > arena->cap - size) return arena->cap;
+
+  dieq_uisz offset = __atomic_fetch_add(&arena->idx, size, __ATOMIC_RELAXED);
+  if (offset > arena->cap || size > arena->cap - offset) return arena->cap;
+  return offset;
+}
+
+void *dieq_atomic_arena_alloc_aligned(Dieq_Atomic_Arena *arena, dieq_uisz size, dieq_uisz align) {
+  if (align == 0 || (align & (align - 1)) != 0) return NULL;
+  if (align < sizeof(void*)) align = sizeof(void*);
+  if (size > (dieq_uisz)-1 - 2*align) return NULL;
+
+  // Claims keep `idx` a multiple of a pointer, so only the alignment beyond that needs slack
+  dieq_uisz claim = dieq__align_forward(size, sizeof(void*)) + align - sizeof(void*);
+  dieq_uisz offset = dieq__atomic_arena_claim(arena, claim);
+  if (offset == arena->cap) return NULL;
+
+  dieq_uisz addr = (dieq_uisz)(arena->buf + offset);
+  return (void*)dieq__align_forward(addr, align);
+}
+
+void *dieq_atomic_arena_alloc(Dieq_Atomic_Arena *arena, dieq_uisz size) {
+  return dieq_atomic_arena_alloc_aligned(arena, size, sizeof(void*));
+}
+
+void *dieq_atomic_arena_alloc_local_aligned(Dieq_Atomic_Arena *arena, Dieq_Atomic_Arena_Local *local, dieq_uisz size, dieq_uisz align) {
+  if (align == 0 || (align & (align - 1)) != 0) return NULL;
 
-void *dieq_realloc(void *ptr, dieq_uisz new_size);
+  if (local->generation == __atomic_load_n(&arena->generation, __ATOMIC_ACQUIRE)) {
+    dieq_uisz addr = (dieq_uisz)(arena->buf + local->idx);
+    dieq_uisz padding = dieq__align_forward(addr, align) - addr;
+    dieq_uisz available = local->end - local->idx;
+    if (padding <= available && size <= available - padding) {
+      local->idx += padding + size;
+      return (void*)(addr + padding);
+    }
+  }
 
+  // Big allocations would mostly waste a chunk, they go straight to the shared buffer
+  if (size > arena->chunk_size/2 || align > arena->chunk_size/2) return dieq_atomic_arena_alloc_aligned(arena, size, align);
 
-typedef struct {
-  dieq_byte *buf;
-  dieq_uisz idx;
-  dieq_uisz cap;
-  Dieq_Allocator allocator;
-} Dieq_Arena;
+  dieq_uisz offset = dieq__atomic_arena_claim(arena, arena->chunk_size);
+  if (offset == arena->cap) return dieq_atomic_arena_alloc_aligned(arena, size, align);
 
-bool dieq_arena_init(Dieq_Arena *arena, dieq_uisz capacity);
+  local->generation = __atomic_load_n(&arena->generation, __ATOMIC_ACQUIRE);
+  local->idx = offset;
+  local->end = offset + arena->chunk_size;
 
-bool dieq_arena_init_with_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator);
+  dieq_uisz addr = (dieq_uisz)(arena->buf + local->idx);
+  dieq_uisz padding = dieq__align_forward(addr, align) - addr;
+  local->idx += padding + size;
+  return (void*)(addr + padding);
+}
 
-bool dieq_arena_init_from_buffer(Dieq_Arena *arena, void *buf, dieq_uisz buf_len);
+void *dieq_atomic_arena_alloc_local(Dieq_Atomic_Arena *arena, Dieq_Atomic_Arena_Local *local, dieq_uisz size) {
+  return dieq_atomic_arena_alloc_local_aligned(arena, local, size, sizeof(void*));
+}
 
-bool dieq_arena_deinit(Dieq_Arena *arena);
+void dieq_atomic_arena_reset(Dieq_Atomic_Arena *arena) {
+  __atomic_store_n(&arena->idx, arena->start, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&arena->generation, 1, __ATOMIC_RELEASE);
+}
 
-void *dieq_arena_alloc(Dieq_Arena *arena, dieq_uisz size);
+void dieq_arena_recycler_init(Dieq_Arena_Recycler *recycler, dieq_uisz max_per_class) {
+  dieq_mem_set(recycler, 0, sizeof(*recycler));
+  recycler->max_per_class = max_per_class < DIEQ_RECYCLER_SLOTS ? max_per_class : DIEQ_RECYCLER_SLOTS;
+}
 
-dieq_uisz dieq_arena_save_point(Dieq_Arena *arena);
+void dieq_arena_recycler_deinit(Dieq_Arena_Recycler *recycler) {
+  for (dieq_uisz c = 0; c < DIEQ_RECYCLER_CLASSES; ++c) {
+    for (dieq_uisz i = 0; i < recycler->counts[c]; ++i) {
+      dieq_arena_deinit(&recycler->slots[c][i].arena);
+    }
+  }
+  dieq_mem_set(recycler, 0, sizeof(*recycler));
+}
 
-void dieq_arena_restore_point(Dieq_Arena *arena, dieq_uisz save_point);
+// Size class holding exactly `capacity` bytes, or DIEQ_RECYCLER_CLASSES when there is none
+static dieq_uisz dieq__recycler_class(dieq_uisz capacity, bool exact) {
+  dieq_uisz size = DIEQ_RECYCLER_MIN_SIZE;
+  for (dieq_uisz c = 0; c < DIEQ_RECYCLER_CLASSES; ++c, size *= 2) {
+    if (exact ? capacity == size : capacity <= size) return c;
+  }
+  return DIEQ_RECYCLER_CLASSES;
+}
 
-typedef struct {
-  void *buf;
-  void *free_list_head;
-  dieq_uisz item_size;
-  dieq_uisz cap;
-  Dieq_Allocator allocator;
-} Dieq_Pool;
+static bool dieq__recycler_new_arena(Dieq_Arena *arena, dieq_uisz capacity) {
+#ifdef DIEQ__LINUX
+  return dieq_arena_init_virtual(arena, capacity);
+#else
+  return dieq_arena_init_with_allocator(arena, capacity, dieq__global_allocator_locked);
+#endif // DIEQ__LINUX
+}
 
-bool dieq_pool_init(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity);
+bool dieq_arena_recycler_acquire(Dieq_Arena_Recycler *recycler, Dieq_Arena *arena, dieq_uisz capacity) {
+  dieq_uisz c = dieq__recycler_class(capacity, false);
+  if (c == DIEQ_RECYCLER_CLASSES) return dieq__recycler_new_arena(arena, capacity);
 
-bool dieq_pool_init_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator);
+  dieq__spin_lock(&recycler->lock);
+  bool found = recycler->counts[c] > 0;
+  // The last one released is the one most likely to still be warm in the cache
+  if (found) *arena = recycler->slots[c][--recycler->counts[c]].arena;
+  dieq__spin_unlock(&recycler->lock);
 
-bool dieq_pool_init_from_buffer(Dieq_Pool *pool, void *buf, dieq_uisz buf_len, dieq_uisz item_size);
+  if (found) return true;
+  return dieq__recycler_new_arena(arena, (dieq_uisz)DIEQ_RECYCLER_MIN_SIZE << c);
+}
 
-bool dieq_pool_deinit(Dieq_Pool *pool);
+void dieq_arena_recycler_release(Dieq_Arena_Recycler *recycler, Dieq_Arena *arena) {
+  // The arena is stored by value, links into the registry would not follow it
+  dieq_arena_unregister(arena);
 
-void *dieq_pool_request(Dieq_Pool *pool);
+  dieq_uisz c = arena->block ? DIEQ_RECYCLER_CLASSES : dieq__recycler_class(arena->cap, true);
+  if (c == DIEQ_RECYCLER_CLASSES) {
+    dieq_arena_deinit(arena);
+    return;
+  }
 
-void dieq_pool_release(Dieq_Pool *pool, void *item);
+  dieq_arena_restore_point(arena, 0);
+  dieq_arena_reset_stats(arena);
 
-void dieq_pool_clear(Dieq_Pool *pool);
+  dieq__spin_lock(&recycler->lock);
+  bool kept = recycler->counts[c] < recycler->max_per_class;
+  if (kept) {
+    Dieq__Recycled_Arena *slot = &recycler->slots[c][recycler->counts[c]++];
+    slot->arena = *arena;
+    slot->idle = 0;
+  }
+  dieq__spin_unlock(&recycler->lock);
 
-dieq_uisz dieq_pool_count_free_nodes(Dieq_Pool *pool);
+  if (!kept) dieq_arena_deinit(arena);
+  else dieq_mem_set(arena, 0, sizeof(*arena));
+}
 
-dieq_uisz dieq_pool_count_used_nodes(Dieq_Pool *pool);
+void dieq_arena_recycler_trim(Dieq_Arena_Recycler *recycler, dieq_uisz max_idle) {
+  dieq__spin_lock(&recycler->lock);
+  for (dieq_uisz c = 0; c < DIEQ_RECYCLER_CLASSES; ++c) {
+    // Slots are in release order, so the idle ones are all at the bottom
+    dieq_uisz dropped = 0;
+    for (dieq_uisz i = 0; i < recycler->counts[c]; ++i) {
+      Dieq__Recycled_Arena *slot = &recycler->slots[c][i];
+      if (slot->idle++ < max_idle) continue;
+#ifdef DIEQ__LINUX
+      // Virtual arenas stay around without their pages, the others have nothing to decommit
+      if (slot->arena.reserved) {
+        dieq_arena_restore_point_decommit(&slot->arena, 0, 0);
+        continue;
+      }
+#endif // DIEQ__LINUX
+      dieq_arena_deinit(&slot->arena);
+      dropped = i + 1;
+    }
+    if (dropped == 0) continue;
 
-#endif // _DIEQ_H
+    // Drop the freed slots at the bottom and slide the rest down
+    dieq_uisz remaining = recycler->counts[c] - dropped;
+    for (dieq_uisz i = 0; i < remaining; ++i) recycler->slots[c][i] = recycler->slots[c][dropped + i];
+    recycler->counts[c] = remaining;
+  }
+  dieq__spin_unlock(&recycler->lock);
+}
 
-#ifdef DIEQ_IMPLEMENTATION
 
+// Overlays the slot of a free item, items in use carry no header at all
 typedef struct {
   void *next;
-  void *prev;
-  dieq_uisz size;
-  dieq_uisz padding;
-} Dieq__Block_Header;
-
-static void *dieq__global_start = NULL;
-static void *dieq__global_end   = NULL;
-static void *dieq__global_head  = NULL;
+} Dieq__Pool_Free_Item;
 
-static inline dieq_uisz dieq__align_forward(dieq_uisz n, dieq_uisz alignment) {
-  return n + (n & (alignment-1));
+static inline dieq_uisz dieq__pool_slot_size(dieq_uisz item_size, dieq_uisz align) {
+  if (item_size < sizeof(Dieq__Pool_Free_Item)) item_size = sizeof(Dieq__Pool_Free_Item);
+  return dieq__align_forward(item_size, align);
 }
 
-void *dieq_mem_set(void *ptr, dieq_byte b, dieq_uisz count) {
-  dieq_byte *data = (dieq_byte*)ptr;
-  for (dieq_uisz i = 0; i < count; ++i) {
-    data[i] = b;
-  }
-  return ptr;
+// Bytes between a `header` at the start of the backing memory and the first slot. Context
+// allocators align the memory itself and only the header needs padding, plain allocators are
+// only good for pointer alignment and anything stricter is made up with slack in front.
+static inline dieq_uisz dieq__pool_slack(Dieq_Pool *pool, dieq_uisz header) {
+  if (pool->align <= sizeof(void*)) return 0;
+  if (pool->ctx_allocator.alloc) return dieq__align_forward(header, pool->align) - header;
+  return pool->align - 1;
 }
 
-void *dieq_mem_cpy(void *restrict dst, void *restrict src, dieq_uisz count) {
-  dieq_byte *dst_buf = (dieq_byte*)dst;
-  dieq_byte *src_buf = (dieq_byte*)src;
-  for (dieq_uisz i = 0; i < count; ++i) dst_buf[i] = src_buf[i];
-  return dst;
+static inline dieq_byte *dieq__pool_items(Dieq_Pool *pool) {
+  return (dieq_byte*)dieq__align_forward((dieq_uisz)pool->buf, pool->align);
 }
 
-void dieq_global_setup(void *start, void *end) {
-  if (dieq__global_start == start) {
-    if (end > dieq__global_end) {
-      dieq_uisz sz = (dieq_uisz)(end - dieq__global_end);
-      dieq_mem_set(dieq__global_end, 0, sz);
-    }
-
-    dieq__global_end = end;
-    return;
-  }
-
-  dieq__global_start = start;
-  dieq__global_end = end;
-  dieq__global_head = NULL;
+struct Dieq__Pool_Chunk {
+  Dieq__Pool_Chunk *next;
+  dieq_uisz cap;
+  dieq_uisz free; // Only meaningful during dieq_pool_trim
+};
 
-  dieq_mem_set(start, 0, (dieq_uisz)(end - start));
+static inline dieq_byte *dieq__pool_chunk_items(Dieq_Pool *pool, Dieq__Pool_Chunk *chunk) {
+  return (dieq_byte*)dieq__align_forward((dieq_uisz)(chunk + 1), pool->align);
 }
 
-void *dieq__find_space(dieq_uisz desired_space) {
-  dieq_uisz true_space = dieq__align_forward(desired_space, sizeof(void*));
+// Nothing is written to the slots up front, requests bump through them until they run out
+static inline void dieq__pool_enter_chunk(Dieq_Pool *pool, Dieq__Pool_Chunk *chunk) {
+  pool->bump = dieq__pool_chunk_items(pool, chunk);
+  pool->bump_end = pool->bump + pool->slot_size*chunk->cap;
+  pool->bump_next = chunk->next;
+}
 
-  if (dieq__global_head == NULL) {
-    Dieq__Block_Header *space_header = (Dieq__Block_Header*)dieq__global_start;
-    space_header->size = true_space;
-    space_header->padding = true_space - desired_space;
-    space_header->next = NULL;
-    space_header->prev = NULL;
-    return dieq__global_start;
-  }
-
-  if (dieq__global_head > dieq__global_start) {
-    if (dieq__global_start + true_space <= dieq__global_head) {
-      void *space = dieq__global_start;
-      Dieq__Block_Header *space_header = (Dieq__Block_Header*)space;
-      space_header->size = true_space;
-      space_header->padding = true_space - desired_space;
-      space_header->next = dieq__global_head;
-      space_header->prev = NULL;
-      space_header->size = desired_space;
-      return space;
-    }
-  }
+// Allocates a chunk of `capacity` slots and starts bumping through it
+static bool dieq__pool_add_chunk(Dieq_Pool *pool, dieq_uisz capacity) {
+  dieq_uisz single = pool->slot_size;
+  dieq_uisz overhead = sizeof(Dieq__Pool_Chunk) + dieq__pool_slack(pool, sizeof(Dieq__Pool_Chunk));
+  if (capacity > ((dieq_uisz)-1 - overhead) / single) return false;
 
-  Dieq__Block_Header *node = (Dieq__Block_Header*)dieq__global_head;
+  Dieq__Pool_Chunk *chunk = dieq__backing_alloc(&pool->allocator, &pool->ctx_allocator, overhead + single*capacity, pool->align);
+  if (chunk == NULL) return false;
+  chunk->cap = capacity;
+  chunk->next = NULL;
+  dieq__pool_enter_chunk(pool, chunk);
 
-  while (node) {
-    void *space = node + node->size;
-
-    if (node->next == NULL ) {
-      if (space < dieq__global_end) {
-        if (space + true_space <= dieq__global_end) {
-          Dieq__Block_Header *space_header = (Dieq__Block_Header*)space;
-          space_header->size = true_space;
-          space_header->padding = true_space - desired_space;
-          space_header->next = NULL;
-          space_header->prev = node;
-          node->next = space;
-          return space;
-        }
-      }
+  chunk->next = pool->chunks;
+  pool->chunks = chunk;
+  pool->cap += capacity;
 
-      return NULL;
-    }
+  return true;
+}
 
-    if (space < node->next) {
-      dieq_uisz diff = (dieq_uisz)node->next - (dieq_uisz)(node + node->size);
-      if (diff <= desired_space) {
-        Dieq__Block_Header *space_header = (Dieq__Block_Header*)space;
-        space_header->size = true_space;
-        space_header->padding = true_space - desired_space;
-        space_header->next = node->next;
-        space_header->prev = node;
-        node->next = space;
-        return space;
-      }
-    }
+static void dieq__pool_free_chunk(Dieq_Pool *pool, Dieq__Pool_Chunk *chunk) {
+  dieq_uisz overhead = sizeof(Dieq__Pool_Chunk) + dieq__pool_slack(pool, sizeof(Dieq__Pool_Chunk));
+  dieq__backing_free(&pool->allocator, &pool->ctx_allocator, chunk, overhead + pool->slot_size*chunk->cap);
+}
 
-    node = node->next;
+static Dieq__Pool_Chunk *dieq__pool_chunk_of(Dieq_Pool *pool, void *slot) {
+  for (Dieq__Pool_Chunk *chunk = pool->chunks; chunk; chunk = chunk->next) {
+    dieq_byte *base = dieq__pool_chunk_items(pool, chunk);
+    if ((dieq_byte*)slot >= base && (dieq_byte*)slot < base + pool->slot_size*chunk->cap) return chunk;
   }
-
   return NULL;
 }
 
-bool dieq__node_exists(void *n) {
-  Dieq__Block_Header *node = (Dieq__Block_Header*)dieq__global_head;
-  while (node) {
-    if (node == n) return true;
-    node = node->next;
+// Finds fresh slots to bump through once the current ones are used up
+static bool dieq__pool_refill(Dieq_Pool *pool) {
+  if (pool->bump_next) {
+    dieq__pool_enter_chunk(pool, pool->bump_next);
+    return true;
   }
-  return false;
-}
+  if (pool->chunks == NULL) return false;
 
-void *dieq_alloc(dieq_uisz size) {
-  void *space = dieq__find_space(sizeof(Dieq__Block_Header) + size);
-  if (space == NULL) return NULL;
+  dieq_uisz capacity = pool->chunks->cap < (dieq_uisz)-1/2 ? pool->chunks->cap*2 : pool->chunks->cap;
+  return dieq__pool_add_chunk(pool, capacity);
+}
 
-  Dieq__Block_Header *header = (Dieq__Block_Header*)space;
-  if (dieq__global_head == NULL) dieq__global_head = (void*)header;
-  dieq_uisz total_size = header->size;
+static bool dieq__pool_init_growable(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Allocator allocator, Dieq_Ctx_Allocator ctx_allocator) {
+  if (item_size == 0) return false;
+  if (capacity == 0) return false;
+  if (align == 0 || (align & (align - 1)) != 0) return false;
+  if (align < sizeof(void*)) align = sizeof(void*);
+  if (item_size > (dieq_uisz)-1 / 2 || align > (dieq_uisz)-1 / 4) return false;
 
-  void *user_ptr = space + sizeof(*header);
-  dieq_mem_set(user_ptr, 0, total_size - sizeof(*header));
+  dieq_mem_set(pool, 0, sizeof(*pool));
+  pool->item_size = item_size;
+  pool->slot_size = dieq__pool_slot_size(item_size, align);
+  pool->align = align;
+  pool->allocator = allocator;
+  pool->ctx_allocator = ctx_allocator;
+  if (!dieq__pool_add_chunk(pool, capacity)) {
+    dieq_mem_set(pool, 0, sizeof(*pool));
+    return false;
+  }
 
-  return user_ptr;
+  return true;
 }
 
-void dieq_free(void *ptr) {
-  if (ptr <= dieq__global_start || ptr >= dieq__global_end) {
-    return; // Maybe should print something here?
-  }
+bool dieq_pool_init_growable(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity) {
+  return dieq_pool_init_growable_aligned(pool, item_size, capacity, sizeof(void*));
+}
 
-  Dieq__Block_Header *header = (Dieq__Block_Header*)(ptr - sizeof(header));
-  if (!dieq__node_exists(header)) {
-    // An error should be presented here since the pointer looks valid but it's not a known node
-    return;
-  }
+bool dieq_pool_init_growable_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator) {
+  return dieq_pool_init_growable_aligned_with_allocator(pool, item_size, capacity, sizeof(void*), allocator);
+}
 
-  Dieq__Block_Header *prev = header->prev;
-  Dieq__Block_Header *next = header->next;
-  if (prev) prev->next = next;
-  if (next) next->prev = prev;
+bool dieq_pool_init_growable_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Ctx_Allocator allocator) {
+  return dieq_pool_init_growable_aligned_with_ctx_allocator(pool, item_size, capacity, sizeof(void*), allocator);
 }
 
-void *dieq_realloc(void *old_ptr, dieq_uisz new_size) {
-  void *new_ptr = dieq_alloc(new_size);
-  if (old_ptr == NULL) return new_ptr;
+bool dieq_pool_init_growable_aligned(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align) {
+  Dieq_Allocator allocator = {
+    .alloc = dieq__alloc_uninit,
+    .free = dieq_free,
+  };
+  return dieq_pool_init_growable_aligned_with_allocator(pool, item_size, capacity, align, allocator);
+}
 
-  Dieq__Block_Header *old_header = (Dieq__Block_Header*)(old_ptr - sizeof(Dieq__Block_Header));
-  dieq_uisz old_size = old_header->size - old_header->padding - sizeof(Dieq__Block_Header);
+bool dieq_pool_init_growable_aligned_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
 
-  dieq_uisz smaller_size = old_size < new_size ? old_size : new_size;
-  dieq_mem_cpy(new_ptr, old_ptr, smaller_size);
+  Dieq_Ctx_Allocator none = {0};
+  return dieq__pool_init_growable(pool, item_size, capacity, align, allocator, none);
+}
 
-  dieq_free(old_ptr);
+bool dieq_pool_init_growable_aligned_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Ctx_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
 
-  return new_ptr;
+  Dieq_Allocator none = {0};
+  return dieq__pool_init_growable(pool, item_size, capacity, align, none, allocator);
 }
 
-void dieq__no_op_allocator_free(void *data) {
-  (void)data;
+static bool dieq__pool_init(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Allocator allocator, Dieq_Ctx_Allocator ctx_allocator) {
+  if (item_size == 0) return false;
+  if (capacity == 0) return false;
+  if (align == 0 || (align & (align - 1)) != 0) return false;
+  if (align < sizeof(void*)) align = sizeof(void*);
+  if (item_size > (dieq_uisz)-1 / 2 || align > (dieq_uisz)-1 / 4) return false;
+
+  Dieq_Pool init = {0};
+  init.item_size = item_size;
+  init.slot_size = dieq__pool_slot_size(item_size, align);
+  init.align = align;
+  init.cap = capacity;
+  init.allocator = allocator;
+  init.ctx_allocator = ctx_allocator;
+
+  dieq_uisz slack = dieq__pool_slack(&init, 0);
+  if (capacity > ((dieq_uisz)-1 - slack) / init.slot_size) return false;
+  init.buf = dieq__backing_alloc(&allocator, &ctx_allocator, slack + init.slot_size*capacity, align);
+  if (init.buf == NULL) return false;
+
+  init.bump = dieq__pool_items(&init);
+  init.bump_end = init.bump + init.slot_size*capacity;
+  *pool = init;
+
+  return true;
 }
 
-bool dieq_arena_init(Dieq_Arena *arena, dieq_uisz capacity) {
-  void *buf = dieq_alloc(capacity);
-  if (buf == NULL) return false;
+bool dieq_pool_init(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity) {
+  return dieq_pool_init_aligned(pool, item_size, capacity, sizeof(void*));
+}
 
-  dieq_mem_set(arena, 0, sizeof(*arena));
-  arena->buf = buf;
-  arena->cap = capacity;
-  arena->allocator.alloc = dieq_alloc;
-  arena->allocator.free = dieq_free;
+bool dieq_pool_init_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator) {
+  return dieq_pool_init_aligned_with_allocator(pool, item_size, capacity, sizeof(void*), allocator);
+}
 
-  return true;
+bool dieq_pool_init_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Ctx_Allocator allocator) {
+  return dieq_pool_init_aligned_with_ctx_allocator(pool, item_size, capacity, sizeof(void*), allocator);
 }
 
+bool dieq_pool_init_aligned(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align) {
+  Dieq_Allocator allocator = {
+    .alloc = dieq__alloc_uninit,
+    .free = dieq_free,
+  };
+  return dieq_pool_init_aligned_with_allocator(pool, item_size, capacity, align, allocator);
+}
 
-bool dieq_arena_init_with_allocator(Dieq_Arena *arena, dieq_uisz capacity, Dieq_Allocator allocator) {
+bool dieq_pool_init_aligned_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Allocator allocator) {
   if (allocator.alloc == NULL) return false;
   if (allocator.free == NULL) return false;
 
-  void *buf = allocator.alloc(capacity);
-  if (buf == NULL) return false;
+  Dieq_Ctx_Allocator none = {0};
+  return dieq__pool_init(pool, item_size, capacity, align, allocator, none);
+}
 
-  dieq_mem_set(arena, 0, sizeof(*arena));
-  arena->buf = buf;
-  arena->cap = capacity;
-  arena->allocator = allocator;
+bool dieq_pool_init_aligned_with_ctx_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, dieq_uisz align, Dieq_Ctx_Allocator allocator) {
+  if (allocator.alloc == NULL) return false;
+  if (allocator.free == NULL) return false;
 
-  return true;
+  Dieq_Allocator none = {0};
+  return dieq__pool_init(pool, item_size, capacity, align, none, allocator);
 }
 
-bool dieq_arena_init_from_buffer(Dieq_Arena *arena, void *buf, dieq_uisz buf_len) {
-  if (buf == NULL || buf_len == 0) return false;
+bool dieq_pool_init_from_buffer(Dieq_Pool *pool, void *buf, dieq_uisz buf_len, dieq_uisz item_size) {
+  if (buf == NULL || item_size == 0) return false;
 
-  dieq_mem_set(arena, 0, sizeof(*arena));
-  arena->buf = buf;
-  arena->cap = buf_len;
-  arena->allocator.free = dieq__no_op_allocator_free;
+  // The slots start at the first pointer aligned address of the buffer
+  dieq_uisz single = dieq__pool_slot_size(item_size, sizeof(void*));
+  dieq_uisz skip = dieq__align_forward((dieq_uisz)buf, sizeof(void*)) - (dieq_uisz)buf;
+  if (skip > buf_len) return false;
+  dieq_uisz capacity = (buf_len - skip) / single;
+  if (capacity == 0) return false;
+
+  dieq_mem_set(pool, 0, sizeof(*pool));
+  pool->buf = buf;
+  pool->item_size = item_size;
+  pool->slot_size = single;
+  pool->align = sizeof(void*);
+  pool->cap = capacity;
+  pool->allocator.free = dieq__no_op_allocator_free;
+  pool->bump = dieq__pool_items(pool);
+  pool->bump_end = pool->bump + capacity*single;
 
   return true;
 }
 
-void *dieq_arena_alloc(Dieq_Arena *arena, dieq_uisz size) {
-  size = dieq__align_forward(size, sizeof(void*));
-  if (arena->idx + size > arena->cap) return NULL;
-  void *ptr = arena->buf + arena->idx;
-  arena->idx += size;
-  return ptr;
+bool dieq_pool_deinit(Dieq_Pool *pool) {
+  if (pool->chunks) {
+    Dieq__Pool_Chunk *chunk = pool->chunks;
+    while (chunk) {
+      Dieq__Pool_Chunk *next = chunk->next;
+      dieq__pool_free_chunk(pool, chunk);
+      chunk = next;
+    }
+  } else if (pool->buf) {
+    if (pool->allocator.free == NULL && pool->ctx_allocator.free == NULL) return false;
+    dieq__backing_free(&pool->allocator, &pool->ctx_allocator, pool->buf, dieq__pool_slack(pool, 0) + pool->slot_size*pool->cap);
+  }
+
+  dieq_mem_set(pool, 0, sizeof(*pool));
+  
+  return true;
 }
 
-dieq_uisz dieq_arena_save_point(Dieq_Arena *arena) {
-  return arena->idx;
+void *dieq_pool_request(Dieq_Pool *pool) {
+  void *item = pool->free_list_head;
+  if (item) {
+    pool->free_list_head = ((Dieq__Pool_Free_Item*)item)->next;
+  } else {
+    if (pool->bump == pool->bump_end && !dieq__pool_refill(pool)) return NULL;
+    item = pool->bump;
+    pool->bump += pool->slot_size;
+  }
+  pool->used += 1;
+  if (pool->used > pool->peak) pool->peak = pool->used;
+  return item;
 }
 
-void dieq_arena_restore_point(Dieq_Arena *arena, dieq_uisz save_point) {
-  arena->idx = save_point;
+void dieq_pool_release(Dieq_Pool *pool, void *item) {
+  pool->used -= 1;
+  ((Dieq__Pool_Free_Item*)item)->next = pool->free_list_head;
+  pool->free_list_head = item;
 }
 
-bool dieq_arena_deinit(Dieq_Arena *arena) {
-  if (arena->buf) {
-    if (arena->allocator.free == NULL) return false;
-    arena->allocator.free(arena->buf);
+void dieq_pool_clear(Dieq_Pool *pool) {
+  pool->free_list_head = NULL;
+  if (pool->chunks) {
+    dieq__pool_enter_chunk(pool, pool->chunks);
+  } else {
+    pool->bump = dieq__pool_items(pool);
+    pool->bump_end = pool->bump + pool->slot_size*pool->cap;
   }
+  pool->used = 0;
+  pool->peak = 0;
+}
 
-  dieq_mem_set(arena, 0, sizeof(*arena));
-  return true;
+dieq_uisz dieq_pool_count_free_nodes(Dieq_Pool *pool) {
+  return pool->cap - pool->used;
 }
 
+dieq_uisz dieq_pool_count_used_nodes(Dieq_Pool *pool) {
+  return pool->used;
+}
 
-typedef struct {
-  void *next;
-} Dieq__Pool_Item_Header;
+dieq_uisz dieq_pool_peak_used_nodes(Dieq_Pool *pool) {
+  return pool->peak;
+}
+
+dieq_uisz dieq_pool_trim(Dieq_Pool *pool) {
+  if (pool->chunks == NULL) return 0;
+
+  // Slots never handed out are free too: the rest of the current chunk and every chunk after it
+  bool untouched = false;
+  for (Dieq__Pool_Chunk *chunk = pool->chunks; chunk; chunk = chunk->next) {
+    if (chunk == pool->bump_next) untouched = true;
+    chunk->free = untouched ? chunk->cap : 0;
+  }
+  Dieq__Pool_Chunk *bumping = pool->bump != pool->bump_end ? dieq__pool_chunk_of(pool, pool->bump) : NULL;
+  if (bumping) bumping->free += (dieq_uisz)(pool->bump_end - pool->bump) / pool->slot_size;
+  for (Dieq__Pool_Free_Item *node = pool->free_list_head; node; node = node->next) {
+    dieq__pool_chunk_of(pool, node)->free += 1;
+  }
+
+  // The oldest chunk is the last one and always stays, the others go once all their items are free
+  bool any = false;
+  for (Dieq__Pool_Chunk *chunk = pool->chunks; chunk->next; chunk = chunk->next) {
+    if (chunk->free == chunk->cap) any = true;
+  }
+  if (!any) return 0;
+
+  // Unlink the items of the chunks that are about to go while keeping the order of the rest
+  Dieq__Pool_Free_Item **link = (Dieq__Pool_Free_Item**)&pool->free_list_head;
+  while (*link) {
+    Dieq__Pool_Chunk *chunk = dieq__pool_chunk_of(pool, *link);
+    if (chunk->next && chunk->free == chunk->cap) *link = (*link)->next;
+    else link = (Dieq__Pool_Free_Item**)&(*link)->next;
+  }
 
-void dieq__pool_setup_headers(dieq_uisz single, void *base, void *end) {
-  for (void *p = base; p < end; p += single) {
-    Dieq__Pool_Item_Header *h = (Dieq__Pool_Item_Header*)p;
-    void *next = p + single;
-    h->next = next >= end ? NULL : next;
+  dieq_uisz released = 0;
+  Dieq__Pool_Chunk **chunk_link = &pool->chunks;
+  while ((*chunk_link)->next) {
+    Dieq__Pool_Chunk *chunk = *chunk_link;
+    if (chunk->free == chunk->cap) {
+      *chunk_link = chunk->next;
+      if (chunk == bumping) pool->bump = pool->bump_end = NULL;
+      if (chunk == pool->bump_next) pool->bump_next = chunk->next;
+      released += chunk->cap;
+      dieq__pool_free_chunk(pool, chunk);
+    } else {
+      chunk_link = &chunk->next;
+    }
   }
+  pool->cap -= released;
+
+  return released;
 }
 
-bool dieq_pool_init(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity) {
-  if (capacity == 0 || item_size == 0) return false;
-  dieq_uisz single = dieq__align_forward(sizeof(Dieq__Pool_Item_Header) + item_size, sizeof(void*));
-  dieq_uisz bytes_count = single * capacity;
-  void *buf = dieq_alloc(bytes_count);
-  void *end = buf + bytes_count;
-  dieq__pool_setup_headers(single, buf, end);
+static void *dieq__pool_ctx_alloc(void *ctx, dieq_uisz size, dieq_uisz align) {
+  Dieq_Pool *pool = (Dieq_Pool*)ctx;
+  if (size > pool->item_size || align > pool->align) return NULL;
+  return dieq_pool_request(pool);
+}
 
-  dieq_mem_set(pool, 0, sizeof(*pool));
-  pool->buf = buf;
-  pool->item_size = item_size;
-  pool->free_list_head = buf;
-  pool->cap = capacity;
-  pool->allocator.alloc = dieq_alloc;
-  pool->allocator.free = dieq_free;
+static void *dieq__pool_ctx_resize(void *ctx, void *ptr, dieq_uisz old_size, dieq_uisz new_size, dieq_uisz align) {
+  (void)old_size;
+  if (ptr == NULL) return dieq__pool_ctx_alloc(ctx, new_size, align);
+  Dieq_Pool *pool = (Dieq_Pool*)ctx;
+  return new_size <= pool->item_size ? ptr : NULL;
+}
 
-  return true;
+static void dieq__pool_ctx_free(void *ctx, void *ptr, dieq_uisz size) {
+  (void)size;
+  if (ptr) dieq_pool_release((Dieq_Pool*)ctx, ptr);
 }
 
-bool dieq_pool_init_with_allocator(Dieq_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator) {
+Dieq_Ctx_Allocator dieq_pool_ctx_allocator(Dieq_Pool *pool) {
+  Dieq_Ctx_Allocator allocator = {
+    .ctx = pool,
+    .alloc = dieq__pool_ctx_alloc,
+    .resize = dieq__pool_ctx_resize,
+    .free = dieq__pool_ctx_free,
+  };
+  return allocator;
+}
+
+bool dieq_atomic_pool_init(Dieq_Atomic_Pool *pool, dieq_uisz item_size, dieq_uisz capacity) {
+  Dieq_Allocator allocator = {
+    .alloc = dieq__alloc_uninit,
+    .free = dieq_free,
+  };
+  return dieq_atomic_pool_init_with_allocator(pool, item_size, capacity, allocator);
+}
+
+bool dieq_atomic_pool_init_with_allocator(Dieq_Atomic_Pool *pool, dieq_uisz item_size, dieq_uisz capacity, Dieq_Allocator allocator) {
   if (item_size == 0) return false;
   if (capacity == 0) return false;
   if (allocator.alloc == NULL) return false;
   if (allocator.free == NULL) return false;
+  if (item_size > (dieq_uisz)-1 / 2) return false;
 
-  dieq_uisz single = dieq__align_forward(sizeof(Dieq__Pool_Item_Header) + item_size, sizeof(void*));
-  dieq_uisz bytes_count = single * capacity;
+  dieq_uisz single = dieq__pool_slot_size(item_size, sizeof(void*));
+  if (capacity > (dieq_uisz)-1 / single) return false;
 
-  void *buf = allocator.alloc(bytes_count);
+  void *buf = allocator.alloc(single * capacity);
   if (buf == NULL) return false;
 
-  dieq__pool_setup_headers(single, buf, buf + bytes_count);
-
-  dieq_mem_set(pool, 0, sizeof(*pool));
-  pool->buf = buf;
-  pool->item_size = item_size;
-  pool->free_list_head = buf;
-  pool->cap = capacity;
+  if (!dieq_atomic_pool_init_from_buffer(pool, buf, single * capacity, item_size)) {
+    allocator.free(buf);
+    return false;
+  }
   pool->allocator = allocator;
 
   return true;
 }
 
-bool dieq_pool_init_from_buffer(Dieq_Pool *pool, void *buf, dieq_uisz buf_len, dieq_uisz item_size) {
-  dieq_uisz single = dieq__align_forward(sizeof(Dieq__Pool_Item_Header) + item_size, sizeof(void*));
-  dieq_uisz capacity = buf_len / single;
-  if (capacity == 0 || item_size == 0) return false;
+bool dieq_atomic_pool_init_from_buffer(Dieq_Atomic_Pool *pool, void *buf, dieq_uisz buf_len, dieq_uisz item_size) {
+  if (buf == NULL || item_size == 0) return false;
+  if (item_size > (dieq_uisz)-1 / 2) return false;
 
-  dieq__pool_setup_headers(single, buf, buf + (capacity * single));
+  // The links in free slots are updated atomically, so the slots start at the first pointer
+  // aligned address of the buffer
+  dieq_uisz skip = dieq__align_forward((dieq_uisz)buf, sizeof(void*)) - (dieq_uisz)buf;
+  if (skip > buf_len) return false;
+
+  // Slot indices have to fit in the low half of the head, with 0 left for the empty stack. Refills
+  // may push `fresh` past the capacity by half a magazine per thread, which has to fit as well
+  dieq_uisz single = dieq__pool_slot_size(item_size, sizeof(void*));
+  dieq_uisz capacity = (buf_len - skip) / single;
+  if (capacity == 0 || capacity > (dieq_u32)-1 / 2) return false;
 
-  dieq_mem_set(pool, 0, sizeof(*pool));
   pool->buf = buf;
-  pool->free_list_head = buf;
+  pool->items = (dieq_byte*)buf + skip;
+  pool->head = 0;
+  pool->fresh = 0;
+  pool->cap = (dieq_u32)capacity;
   pool->item_size = item_size;
-  pool->cap = capacity;
+  pool->slot_size = single;
+  pool->allocator.alloc = NULL;
   pool->allocator.free = dieq__no_op_allocator_free;
 
   return true;
 }
 
-bool dieq_pool_deinit(Dieq_Pool *pool) {
+bool dieq_atomic_pool_deinit(Dieq_Atomic_Pool *pool) {
   if (pool->buf) {
     if (pool->allocator.free == NULL) return false;
     pool->allocator.free(pool->buf);
   }
 
   dieq_mem_set(pool, 0, sizeof(*pool));
-  
   return true;
 }
 
-void *dieq_pool_request(Dieq_Pool *pool) {
-  if (pool->free_list_head == NULL) return NULL;
-  void *data = pool->free_list_head + sizeof(Dieq__Pool_Item_Header);
-  Dieq__Pool_Item_Header *h = (Dieq__Pool_Item_Header*)pool->free_list_head;
-  pool->free_list_head = h->next;
-  return data;
+static dieq_u32 dieq__atomic_pool_index(Dieq_Atomic_Pool *pool, void *item) {
+  return (dieq_u32)(((dieq_byte*)item - pool->items) / pool->slot_size) + 1;
 }
 
-void dieq_pool_release(Dieq_Pool *pool, void *item) {
-  void *head = item - sizeof(Dieq__Pool_Item_Header);
-  if (pool->free_list_head == NULL) {
-    pool->free_list_head = head;
-    return;
+// Takes up to `n` items off the stack with one CAS and makes up for the ones missing with slots
+// that were never used, claimed with one fetch-add. Returns how many items it stored.
+static dieq_uisz dieq__atomic_pool_pop(Dieq_Atomic_Pool *pool, void **items, dieq_uisz n) {
+  dieq_uisz count = 0;
+  dieq_u64 head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+  while ((dieq_u32)head != 0) {
+    // Other threads may have taken any of these slots and be writing to them already, the links
+    // are garbage then but the generation has moved on as well and the CAS below fails
+    dieq_u32 next = (dieq_u32)head;
+    for (count = 0; count < n && next != 0 && next <= pool->cap; ++count) {
+      dieq_byte *slot = pool->items + (dieq_uisz)(next - 1) * pool->slot_size;
+      items[count] = slot;
+      next = __atomic_load_n((dieq_u32*)slot, __ATOMIC_RELAXED);
+    }
+
+    if (next > pool->cap) {
+      head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    } else {
+      dieq_u64 popped = (((head >> 32) + 1) << 32) | next;
+      if (__atomic_compare_exchange_n(&pool->head, &head, popped, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) break;
+    }
+    count = 0;
+  }
+
+  if (count < n && __atomic_load_n(&pool->fresh, __ATOMIC_RELAXED) < pool->cap) {
+    dieq_u32 index = __atomic_fetch_add(&pool->fresh, (dieq_u32)(n - count), __ATOMIC_RELAXED);
+    while (count < n && index < pool->cap) items[count++] = pool->items + (dieq_uisz)index++ * pool->slot_size;
   }
 
-  Dieq__Pool_Item_Header *h = (Dieq__Pool_Item_Header*)head;
-  h->next = pool->free_list_head;
-  pool->free_list_head = head;
+  return count;
 }
 
-void dieq_pool_clear(Dieq_Pool *pool) {
-  dieq_uisz single = dieq__align_forward(sizeof(Dieq__Pool_Item_Header) + pool->item_size, sizeof(void*));
-  dieq_uisz bytes_count = single * pool->cap;
-  void *end = pool->buf + bytes_count;
-  dieq__pool_setup_headers(single, pool->buf, end);
-  pool->free_list_head = pool->buf;
+// Links the `n` items into a chain first, so all of them go onto the stack with one CAS
+static void dieq__atomic_pool_push(Dieq_Atomic_Pool *pool, void **items, dieq_uisz n) {
+  for (dieq_uisz i = 0; i + 1 < n; ++i) {
+    __atomic_store_n((dieq_u32*)items[i], dieq__atomic_pool_index(pool, items[i + 1]), __ATOMIC_RELAXED);
+  }
+
+  dieq_u32 top = dieq__atomic_pool_index(pool, items[0]);
+  dieq_u64 head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+  dieq_u64 pushed;
+  do {
+    __atomic_store_n((dieq_u32*)items[n - 1], (dieq_u32)head, __ATOMIC_RELAXED);
+    pushed = (((head >> 32) + 1) << 32) | top;
+  } while (!__atomic_compare_exchange_n(&pool->head, &head, pushed, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
 
-dieq_uisz dieq_pool_count_free_nodes(Dieq_Pool *pool) {
-  dieq_uisz count = 0;
-  Dieq__Pool_Item_Header *node = (Dieq__Pool_Item_Header*)pool->free_list_head;
-  while (node) {
-    node = (Dieq__Pool_Item_Header*)node->next;
-    count++;
+void *dieq_atomic_pool_request(Dieq_Atomic_Pool *pool) {
+  void *item = NULL;
+  dieq__atomic_pool_pop(pool, &item, 1);
+  return item;
+}
+
+void dieq_atomic_pool_release(Dieq_Atomic_Pool *pool, void *item) {
+  dieq__atomic_pool_push(pool, &item, 1);
+}
+
+void *dieq_atomic_pool_request_local(Dieq_Atomic_Pool *pool, Dieq_Atomic_Pool_Local *local) {
+  if (local->count == 0) {
+    // Half a magazine, so a thread that alternates requests and releases doesn't bounce at the edge
+    local->count = dieq__atomic_pool_pop(pool, local->items, DIEQ_POOL_MAGAZINE_SIZE/2);
+    if (local->count == 0) return NULL;
   }
-  return count;
+  return local->items[--local->count];
 }
 
-dieq_uisz dieq_pool_count_used_nodes(Dieq_Pool *pool) {
-  return pool->cap - dieq_pool_count_free_nodes(pool);
+void dieq_atomic_pool_release_local(Dieq_Atomic_Pool *pool, Dieq_Atomic_Pool_Local *local, void *item) {
+  if (local->count == DIEQ_POOL_MAGAZINE_SIZE) {
+    dieq__atomic_pool_push(pool, local->items + DIEQ_POOL_MAGAZINE_SIZE/2, DIEQ_POOL_MAGAZINE_SIZE/2);
+    local->count = DIEQ_POOL_MAGAZINE_SIZE/2;
+  }
+  local->items[local->count++] = item;
 }
 
+void dieq_atomic_pool_flush_local(Dieq_Atomic_Pool *pool, Dieq_Atomic_Pool_Local *local) {
+  if (local->count > 0) dieq__atomic_pool_push(pool, local->items, local->count);
+  local->count = 0;
+}
 
 #endif // DIEQ_IMPLEMENTATION
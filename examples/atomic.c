@@ -0,0 +1,191 @@
+/**
+ * Beats on Dieq_Atomic_Arena and Dieq_Atomic_Pool from a bunch of threads at once, no window
+ * this time, it just prints what it checked and exits with 1 when something went wrong.
+ *
+ * Every thread stamps the memory it got with its own id and looks at it again later, so two
+ * threads ever handed the same bytes shows up as a mismatch. The arena runs several rounds with
+ * a reset in between while the threads hold on to their Dieq_Atomic_Arena_Local, which makes
+ * them throw away chunks from before the reset. The pool part ends by draining the pool to see
+ * that every slot came back exactly once, and by replaying the ABA interleaving that the
+ * generation in the head of the pool is there for.
+ *
+ * ThreadSanitizer points at one spot in the pool, where a pop reads the link of a slot another
+ * thread may have taken and be writing to already. That read is thrown away with the failed CAS
+ * that follows it, it's the one race a Treiber stack can't get rid of.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define DIEQ_IMPLEMENTATION
+#include "dieq.h"
+
+#define THREAD_COUNT 8
+#define ARENA_ROUNDS 16
+#define ARENA_ALLOCS 4096
+#define POOL_CAPACITY 512
+#define POOL_ITERATIONS 200000
+#define POOL_HELD 16
+
+#define check(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+typedef struct {
+  uint8_t *ptr;
+  size_t size;
+} Stamped;
+
+typedef struct {
+  uint8_t id;
+  Dieq_Atomic_Arena_Local local; // Kept across rounds on purpose, resets have to invalidate it
+  Stamped stamped[ARENA_ALLOCS];
+  size_t count;
+} Arena_Worker;
+
+static Dieq_Atomic_Arena arena;
+static Arena_Worker arena_workers[THREAD_COUNT];
+
+static void *arena_worker(void *arg) {
+  Arena_Worker *worker = arg;
+  worker->count = 0;
+
+  for (size_t i = 0; i < ARENA_ALLOCS; ++i) {
+    size_t size = 1 + (i*7 + worker->id) % 96;
+    size_t align = (size_t)1 << (i % 7);
+    // Mostly through the local chunk, every so often straight from the shared counter
+    uint8_t *ptr = i % 16 == 0
+      ? dieq_atomic_arena_alloc_aligned(&arena, size, align)
+      : dieq_atomic_arena_alloc_local_aligned(&arena, &worker->local, size, align);
+    if (ptr == NULL) break;
+    check(((uintptr_t)ptr & (align - 1)) == 0);
+
+    memset(ptr, worker->id, size);
+    worker->stamped[worker->count++] = (Stamped){ ptr, size };
+  }
+
+  return NULL;
+}
+
+static void run_arena(void) {
+  // Small enough that the later allocations of a round run the arena dry
+  check(dieq_atomic_arena_init(&arena, THREAD_COUNT*ARENA_ALLOCS*32, 4096));
+
+  for (size_t round = 0; round < ARENA_ROUNDS; ++round) {
+    pthread_t threads[THREAD_COUNT];
+    for (size_t t = 0; t < THREAD_COUNT; ++t) {
+      arena_workers[t].id = (uint8_t)(t + 1);
+      check(pthread_create(&threads[t], NULL, arena_worker, &arena_workers[t]) == 0);
+    }
+    for (size_t t = 0; t < THREAD_COUNT; ++t) pthread_join(threads[t], NULL);
+
+    size_t total = 0;
+    for (size_t t = 0; t < THREAD_COUNT; ++t) {
+      Arena_Worker *worker = &arena_workers[t];
+      for (size_t i = 0; i < worker->count; ++i) {
+        Stamped s = worker->stamped[i];
+        check(s.ptr >= arena.buf && s.ptr + s.size <= arena.buf + arena.cap);
+        for (size_t k = 0; k < s.size; ++k) check(s.ptr[k] == worker->id);
+      }
+      total += worker->count;
+    }
+    // Claims that did not fit still moved `idx` past the end
+    size_t claimed = arena.idx < arena.cap ? arena.idx : arena.cap;
+    printf("arena round %2zu: %zu allocations, %zu bytes claimed\n", round, total, claimed);
+
+    // Everything handed out so far is gone, the locals notice the new generation on their own
+    dieq_atomic_arena_reset(&arena);
+  }
+
+  dieq_atomic_arena_deinit(&arena);
+}
+
+static Dieq_Atomic_Pool pool;
+
+static void *pool_worker(void *arg) {
+  uint8_t id = (uint8_t)(uintptr_t)arg;
+  bool use_local = id % 2 == 0;
+  Dieq_Atomic_Pool_Local local = {0};
+  uint8_t *held[POOL_HELD];
+  size_t count = 0;
+
+  for (size_t i = 0; i < POOL_ITERATIONS; ++i) {
+    if (count < POOL_HELD && i % 3 != 2) {
+      uint8_t *item = use_local ? dieq_atomic_pool_request_local(&pool, &local) : dieq_atomic_pool_request(&pool);
+      // Running dry is expected, the magazines of the other threads hold on to items
+      if (item == NULL) continue;
+      memset(item, id, pool.item_size);
+      held[count++] = item;
+    } else if (count > 0) {
+      uint8_t *item = held[--count];
+      for (size_t k = 0; k < pool.item_size; ++k) check(item[k] == id);
+      if (use_local) dieq_atomic_pool_release_local(&pool, &local, item);
+      else dieq_atomic_pool_release(&pool, item);
+    }
+  }
+
+  while (count > 0) {
+    if (use_local) dieq_atomic_pool_release_local(&pool, &local, held[--count]);
+    else dieq_atomic_pool_release(&pool, held[--count]);
+  }
+  dieq_atomic_pool_flush_local(&pool, &local);
+
+  return NULL;
+}
+
+static void run_pool(void) {
+  check(dieq_atomic_pool_init(&pool, 40, POOL_CAPACITY));
+
+  pthread_t threads[THREAD_COUNT];
+  for (size_t t = 0; t < THREAD_COUNT; ++t) {
+    check(pthread_create(&threads[t], NULL, pool_worker, (void*)(uintptr_t)(t + 1)) == 0);
+  }
+  for (size_t t = 0; t < THREAD_COUNT; ++t) pthread_join(threads[t], NULL);
+
+  // Every slot has to be free again, and each one exactly once
+  static uint8_t *items[POOL_CAPACITY];
+  size_t count = 0;
+  uint8_t *item;
+  while ((item = dieq_atomic_pool_request(&pool)) != NULL) {
+    check(count < POOL_CAPACITY);
+    items[count++] = item;
+  }
+  check(count == POOL_CAPACITY);
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = i + 1; j < count; ++j) check(items[i] != items[j]);
+  }
+  printf("pool: %d threads, all %zu slots came back once\n", THREAD_COUNT, count);
+
+  // The ABA case, played out by hand on one thread. A stalled pop read the head while A was on
+  // top with B below it, then the others popped A and B and pushed A back. The top is A again
+  // but B is in use, a head holding only the index would let the stalled CAS install B.
+  for (size_t i = 0; i < count; ++i) dieq_atomic_pool_release(&pool, items[count - 1 - i]);
+  dieq_u64 stalled_head = __atomic_load_n(&pool.head, __ATOMIC_ACQUIRE);
+  dieq_u32 stalled_next = *(dieq_u32*)(pool.items + (size_t)((dieq_u32)stalled_head - 1)*pool.slot_size);
+
+  void *a = dieq_atomic_pool_request(&pool);
+  void *b = dieq_atomic_pool_request(&pool);
+  dieq_atomic_pool_release(&pool, a);
+  check((dieq_u32)__atomic_load_n(&pool.head, __ATOMIC_ACQUIRE) == (dieq_u32)stalled_head);
+
+  dieq_u64 popped = (((stalled_head >> 32) + 1) << 32) | stalled_next;
+  bool swapped = __atomic_compare_exchange_n(&pool.head, &stalled_head, popped, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+  check(!swapped);
+  check(dieq_atomic_pool_request(&pool) == a);
+  check(dieq_atomic_pool_request(&pool) != b);
+  printf("pool: the stalled pop of the ABA case failed its CAS\n");
+
+  dieq_atomic_pool_deinit(&pool);
+}
+
+int main(void) {
+  static uint8_t memory[16*1024*1024];
+  dieq_global_setup(memory, memory + sizeof(memory));
+
+  run_arena();
+  run_pool();
+
+  printf("OK\n");
+  return 0;
+}
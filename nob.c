@@ -46,7 +46,7 @@ bool build_example(Cmd *cmd, const char *example_name) {
     nob_cc(cmd);
     nob_cc_flags(cmd);
     nob_cc_output(cmd, output_path);
-    cmd_append(cmd, "-lSDL3", "-lm");
+    cmd_append(cmd, "-lSDL3", "-lm", "-lpthread");
     cmd_append(cmd, "-I.");
     if (opt.flags.debug_info) {
       cmd_append(cmd, "-ggdb");
@@ -124,6 +124,7 @@ int main(int argc, char **argv) {
     // clang -o build/dieq.wasm wasm.c --target=wasm32 -Wl,--export=all -Wl,--allow-undefined -nostdlib -Wl,--no-entry
     cmd_append(&cmd, "clang");
     cmd_append(&cmd, "--target=wasm32", "-nostdlib", "-Wl,--allow-undefined", "-Wl,--no-entry");
+    cmd_append(&cmd, "-msimd128"); // Lets dieq_mem_set/dieq_mem_cpy use the 128-bit vector kernels
     cmd_append(&cmd, "-Wl,--export=__heap_base", "-Wl,--export=__heap_end");
     cmd_append(&cmd, "-Wl,--export=dieq_global_setup");
     cmd_append(&cmd, "-Wl,--export=dieq_alloc", "-Wl,--export=dieq_free", "-Wl,--export=dieq_realloc");